@@ -0,0 +1,1171 @@
+#include "bucket_tree.h"
+#include "rbtree.h"
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Cross-structure comparison: the same workload runs against rbtree and a
+// set of reference structures, one CSV row per (structure, size, phase).
+
+// Capabilities decide which phases a structure takes part in
+#define CAP_POINT 1    // insert/find/erase by key
+#define CAP_ORDERED 2  // in-order scan
+#define CAP_PQ 4       // pop_min
+
+typedef struct {
+  const char *name;
+  unsigned caps;
+  // Above this size keys are bulk-loaded instead of inserted one at a time and
+  // the erase/pop_min phases are skipped (0 = no limit)
+  size_t max_mutate;
+  void *(*create)(void);
+  void (*destroy)(void *);
+  int (*insert)(void *, const rbtree_key_t);  // 0 on success
+  int (*bulk)(void *, const rbtree_key_t *, const size_t);
+  int (*find)(void *, const rbtree_key_t);  // 1 when present
+  int (*erase)(void *, const rbtree_key_t);  // 0 on success
+  int (*pop_min)(void *, rbtree_key_t *);    // 0 on success
+  size_t (*scan)(void *);             // keys visited in order
+} structure_t;
+
+// Keeps the scans from being optimized away
+static volatile int64_t scan_sink;
+
+/* rbtree */
+
+static void *rb_create(void) { return new_rbtree(); }
+
+static void rb_destroy(void *s) { delete_rbtree(s); }
+
+static int rb_insert(void *s, const rbtree_key_t k) {
+  return rbtree_insert(s, k) == NULL ? -1 : 0;
+}
+
+static int rb_find(void *s, const rbtree_key_t k) { return rbtree_find(s, k) != NULL; }
+
+static int rb_erase(void *s, const rbtree_key_t k) {
+  node_t *p = rbtree_find(s, k);
+  return p == NULL ? -1 : rbtree_erase(s, p);
+}
+
+static int rb_pop_min(void *s, rbtree_key_t *k) {
+  rbtree *t = s;
+  node_t *p = rbtree_min(t);
+  if (p == NULL || p == t->nil) {
+    return -1;
+  }
+  *k = p->key;
+  return rbtree_erase(t, p);
+}
+
+static size_t rb_scan(void *s) {
+  rbtree *t = s;
+  size_t n = 0;
+  int64_t sum = 0;
+  node_t *p = rbtree_min(t);
+  if (p == t->nil) {
+    p = NULL;
+  }
+  for (; p != NULL; p = rbtree_next(t, p)) {
+    sum += p->key;
+    n++;
+  }
+  scan_sink = sum;
+  return n;
+}
+
+/* bucket_tree: rbtree index over sorted leaf buckets */
+
+static void *bt_create(void) { return new_bucket_tree(); }
+
+static void bt_destroy(void *s) { delete_bucket_tree(s); }
+
+static int bt_insert(void *s, const rbtree_key_t k) { return bucket_tree_insert(s, k); }
+
+static int bt_find(void *s, const rbtree_key_t k) {
+  return bucket_tree_find(s, k) != NULL;
+}
+
+static int bt_erase(void *s, const rbtree_key_t k) { return bucket_tree_erase(s, k); }
+
+static int bt_pop_min(void *s, rbtree_key_t *k) {
+  const rbtree_key_t *m = bucket_tree_min(s);
+  if (m == NULL) {
+    return -1;
+  }
+  *k = *m;
+  return bucket_tree_erase(s, *k);
+}
+
+static size_t bt_scan(void *s) {
+  bucket_tree *t = s;
+  size_t n = 0;
+  int64_t sum = 0;
+  node_t *p = rbtree_min(t->index);
+  if (p == t->index->nil) {
+    p = NULL;
+  }
+  for (; p != NULL; p = rbtree_next(t->index, p)) {
+    const bucket_t *b = (const bucket_t *)p;
+    for (int i = 0; i < b->count; i++) {
+      sum += b->keys[i];
+    }
+    n += b->count;
+  }
+  scan_sink = sum;
+  return n;
+}
+
+/* sorted vector */
+
+typedef struct {
+  rbtree_key_t *keys;
+  size_t count, cap;
+} vec_t;
+
+static size_t lower_bound(const rbtree_key_t *keys, const size_t n, const rbtree_key_t k) {
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (keys[mid] < k) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void *vec_create(void) { return calloc(1, sizeof(vec_t)); }
+
+static void vec_destroy(void *s) {
+  vec_t *v = s;
+  free(v->keys);
+  free(v);
+}
+
+static int vec_reserve(vec_t *v, const size_t n) {
+  if (n <= v->cap) {
+    return 0;
+  }
+  size_t cap = v->cap == 0 ? 16 : v->cap;
+  while (cap < n) {
+    cap *= 2;
+  }
+  rbtree_key_t *keys = realloc(v->keys, cap * sizeof(rbtree_key_t));
+  if (keys == NULL) {
+    return -1;
+  }
+  v->keys = keys;
+  v->cap = cap;
+  return 0;
+}
+
+static int vec_insert(void *s, const rbtree_key_t k) {
+  vec_t *v = s;
+  const size_t i = lower_bound(v->keys, v->count, k);
+  if ((i < v->count && v->keys[i] == k) || vec_reserve(v, v->count + 1) != 0) {
+    return -1;
+  }
+  memmove(v->keys + i + 1, v->keys + i, (v->count - i) * sizeof(rbtree_key_t));
+  v->keys[i] = k;
+  v->count++;
+  return 0;
+}
+
+static int comp_key(const void *p1, const void *p2) {
+  const rbtree_key_t a = *(const rbtree_key_t *)p1, b = *(const rbtree_key_t *)p2;
+  return a < b ? -1 : a > b;
+}
+
+static int vec_bulk(void *s, const rbtree_key_t *keys, const size_t n) {
+  vec_t *v = s;
+  if (vec_reserve(v, n) != 0) {
+    return -1;
+  }
+  memcpy(v->keys, keys, n * sizeof(rbtree_key_t));
+  qsort(v->keys, n, sizeof(rbtree_key_t), comp_key);
+  v->count = n;
+  return 0;
+}
+
+static int vec_find(void *s, const rbtree_key_t k) {
+  vec_t *v = s;
+  const size_t i = lower_bound(v->keys, v->count, k);
+  return i < v->count && v->keys[i] == k;
+}
+
+static int vec_erase(void *s, const rbtree_key_t k) {
+  vec_t *v = s;
+  const size_t i = lower_bound(v->keys, v->count, k);
+  if (i == v->count || v->keys[i] != k) {
+    return -1;
+  }
+  v->count--;
+  memmove(v->keys + i, v->keys + i + 1, (v->count - i) * sizeof(rbtree_key_t));
+  return 0;
+}
+
+static int vec_pop_min(void *s, rbtree_key_t *k) {
+  vec_t *v = s;
+  if (v->count == 0) {
+    return -1;
+  }
+  *k = v->keys[0];
+  return vec_erase(v, *k);
+}
+
+static size_t vec_scan(void *s) {
+  vec_t *v = s;
+  int64_t sum = 0;
+  for (size_t i = 0; i < v->count; i++) {
+    sum += v->keys[i];
+  }
+  scan_sink = sum;
+  return v->count;
+}
+
+/* skip list (p = 1/4) */
+
+#define SKIP_MAX_LEVEL 32
+
+typedef struct skip_node {
+  rbtree_key_t key;
+  struct skip_node *next[];  // as many levels as the node was given
+} skip_node;
+
+typedef struct {
+  skip_node *head;
+  int level;
+  uint64_t rng;
+} skiplist_t;
+
+static void *skip_create(void) {
+  skiplist_t *l = malloc(sizeof(skiplist_t));
+  if (l == NULL) {
+    return NULL;
+  }
+  l->head = calloc(1, sizeof(skip_node) + SKIP_MAX_LEVEL * sizeof(skip_node *));
+  if (l->head == NULL) {
+    free(l);
+    return NULL;
+  }
+  l->level = 1;
+  l->rng = 0x9E3779B97F4A7C15ull;
+  return l;
+}
+
+static void skip_destroy(void *s) {
+  skiplist_t *l = s;
+  skip_node *x = l->head;
+  while (x != NULL) {
+    skip_node *next = x->next[0];
+    free(x);
+    x = next;
+  }
+  free(l);
+}
+
+static int skip_random_level(skiplist_t *l) {
+  // xorshift64; every two trailing zero bits promote the node one level
+  l->rng ^= l->rng << 13;
+  l->rng ^= l->rng >> 7;
+  l->rng ^= l->rng << 17;
+  const int level = 1 + __builtin_ctzll(l->rng | (1ull << 62)) / 2;
+  return level < SKIP_MAX_LEVEL ? level : SKIP_MAX_LEVEL;
+}
+
+// Fills update[] with the last node before k on every level
+static skip_node *skip_search(const skiplist_t *l, const rbtree_key_t k,
+                              skip_node **update) {
+  skip_node *x = l->head;
+  for (int i = l->level - 1; i >= 0; i--) {
+    while (x->next[i] != NULL && x->next[i]->key < k) {
+      x = x->next[i];
+    }
+    if (update != NULL) {
+      update[i] = x;
+    }
+  }
+  return x->next[0];
+}
+
+static int skip_insert(void *s, const rbtree_key_t k) {
+  skiplist_t *l = s;
+  skip_node *update[SKIP_MAX_LEVEL];
+  skip_node *x = skip_search(l, k, update);
+  if (x != NULL && x->key == k) {
+    return -1;
+  }
+  const int level = skip_random_level(l);
+  for (; l->level < level; l->level++) {
+    update[l->level] = l->head;
+  }
+  x = malloc(sizeof(skip_node) + level * sizeof(skip_node *));
+  if (x == NULL) {
+    return -1;
+  }
+  x->key = k;
+  for (int i = 0; i < level; i++) {
+    x->next[i] = update[i]->next[i];
+    update[i]->next[i] = x;
+  }
+  return 0;
+}
+
+static int skip_find(void *s, const rbtree_key_t k) {
+  const skip_node *x = skip_search(s, k, NULL);
+  return x != NULL && x->key == k;
+}
+
+// Unlinks x from every level where prev[i] points at it
+static void skip_unlink(skiplist_t *l, skip_node *x, skip_node **prev) {
+  for (int i = 0; i < l->level && prev[i]->next[i] == x; i++) {
+    prev[i]->next[i] = x->next[i];
+  }
+  free(x);
+  while (l->level > 1 && l->head->next[l->level - 1] == NULL) {
+    l->level--;
+  }
+}
+
+static int skip_erase(void *s, const rbtree_key_t k) {
+  skiplist_t *l = s;
+  skip_node *update[SKIP_MAX_LEVEL];
+  skip_node *x = skip_search(l, k, update);
+  if (x == NULL || x->key != k) {
+    return -1;
+  }
+  skip_unlink(l, x, update);
+  return 0;
+}
+
+static int skip_pop_min(void *s, rbtree_key_t *k) {
+  skiplist_t *l = s;
+  skip_node *x = l->head->next[0];
+  if (x == NULL) {
+    return -1;
+  }
+  skip_node *prev[SKIP_MAX_LEVEL];
+  for (int i = 0; i < l->level; i++) {
+    prev[i] = l->head;
+  }
+  *k = x->key;
+  skip_unlink(l, x, prev);
+  return 0;
+}
+
+static size_t skip_scan(void *s) {
+  skiplist_t *l = s;
+  size_t n = 0;
+  int64_t sum = 0;
+  for (const skip_node *x = l->head->next[0]; x != NULL; x = x->next[0]) {
+    sum += x->key;
+    n++;
+  }
+  scan_sink = sum;
+  return n;
+}
+
+/* B+-tree */
+
+#define BP_MAX 64  // keys per node
+#define BP_MIN (BP_MAX / 2)
+
+// Internal nodes hold n keys and n + 1 children; keys[i] separates child[i]
+// (< keys[i]) from child[i + 1] (>= keys[i]). Leaves keep only child[0], the
+// next leaf in key order. One spare key/child slot absorbs overflow before a
+// split.
+typedef struct bp_node {
+  int leaf;
+  int n;
+  rbtree_key_t keys[BP_MAX + 1];
+  struct bp_node *child[];
+} bp_node;
+
+#define BP_NEXT(x) ((x)->child[0])
+
+typedef struct {
+  bp_node *root;
+} bptree_t;
+
+static bp_node *bp_new_node(const int leaf) {
+  const size_t children = leaf ? 1 : BP_MAX + 2;
+  bp_node *x = malloc(sizeof(bp_node) + children * sizeof(bp_node *));
+  if (x != NULL) {
+    x->leaf = leaf;
+    x->n = 0;
+    x->child[0] = NULL;
+  }
+  return x;
+}
+
+static void *bp_create(void) {
+  bptree_t *t = malloc(sizeof(bptree_t));
+  if (t == NULL) {
+    return NULL;
+  }
+  t->root = bp_new_node(1);
+  if (t->root == NULL) {
+    free(t);
+    return NULL;
+  }
+  return t;
+}
+
+static void bp_free(bp_node *x) {
+  if (!x->leaf) {
+    for (int i = 0; i <= x->n; i++) {
+      bp_free(x->child[i]);
+    }
+  }
+  free(x);
+}
+
+static void bp_destroy(void *s) {
+  bptree_t *t = s;
+  bp_free(t->root);
+  free(t);
+}
+
+// Index of the child whose range contains k
+static int bp_child_index(const bp_node *x, const rbtree_key_t k) {
+  int lo = 0, hi = x->n;
+  while (lo < hi) {
+    const int mid = (lo + hi) / 2;
+    if (x->keys[mid] <= k) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static int bp_find(void *s, const rbtree_key_t k) {
+  const bp_node *x = ((bptree_t *)s)->root;
+  while (!x->leaf) {
+    x = x->child[bp_child_index(x, k)];
+  }
+  const size_t i = lower_bound(x->keys, x->n, k);
+  return i < (size_t)x->n && x->keys[i] == k;
+}
+
+// On a split *up receives the new right sibling and *up_key its separator
+static int bp_insert_rec(bp_node *x, const rbtree_key_t k, rbtree_key_t *up_key,
+                         bp_node **up) {
+  *up = NULL;
+  if (x->leaf) {
+    const int i = (int)lower_bound(x->keys, x->n, k);
+    if (i < x->n && x->keys[i] == k) {
+      return -1;
+    }
+    memmove(x->keys + i + 1, x->keys + i, (x->n - i) * sizeof(rbtree_key_t));
+    x->keys[i] = k;
+    if (++x->n <= BP_MAX) {
+      return 0;
+    }
+    bp_node *right = bp_new_node(1);
+    if (right == NULL) {
+      return -1;
+    }
+    const int half = x->n / 2;
+    right->n = x->n - half;
+    memcpy(right->keys, x->keys + half, right->n * sizeof(rbtree_key_t));
+    x->n = half;
+    BP_NEXT(right) = BP_NEXT(x);
+    BP_NEXT(x) = right;
+    *up_key = right->keys[0];
+    *up = right;
+    return 0;
+  }
+
+  const int i = bp_child_index(x, k);
+  rbtree_key_t sep;
+  bp_node *split;
+  if (bp_insert_rec(x->child[i], k, &sep, &split) != 0) {
+    return -1;
+  }
+  if (split == NULL) {
+    return 0;
+  }
+  memmove(x->keys + i + 1, x->keys + i, (x->n - i) * sizeof(rbtree_key_t));
+  memmove(x->child + i + 2, x->child + i + 1, (x->n - i) * sizeof(bp_node *));
+  x->keys[i] = sep;
+  x->child[i + 1] = split;
+  if (++x->n <= BP_MAX) {
+    return 0;
+  }
+  // The middle key moves up; the right half keeps the keys after it
+  bp_node *right = bp_new_node(0);
+  if (right == NULL) {
+    return -1;
+  }
+  const int mid = x->n / 2;
+  right->n = x->n - mid - 1;
+  memcpy(right->keys, x->keys + mid + 1, right->n * sizeof(rbtree_key_t));
+  memcpy(right->child, x->child + mid + 1, (right->n + 1) * sizeof(bp_node *));
+  x->n = mid;
+  *up_key = x->keys[mid];
+  *up = right;
+  return 0;
+}
+
+static int bp_insert(void *s, const rbtree_key_t k) {
+  bptree_t *t = s;
+  rbtree_key_t sep;
+  bp_node *split;
+  if (bp_insert_rec(t->root, k, &sep, &split) != 0) {
+    return -1;
+  }
+  if (split != NULL) {
+    bp_node *root = bp_new_node(0);
+    if (root == NULL) {
+      return -1;
+    }
+    root->n = 1;
+    root->keys[0] = sep;
+    root->child[0] = t->root;
+    root->child[1] = split;
+    t->root = root;
+  }
+  return 0;
+}
+
+// Folds child[i + 1] into child[i] and drops their separator from p
+static void bp_merge(bp_node *p, const int i) {
+  bp_node *l = p->child[i], *r = p->child[i + 1];
+  if (l->leaf) {
+    memcpy(l->keys + l->n, r->keys, r->n * sizeof(rbtree_key_t));
+    l->n += r->n;
+    BP_NEXT(l) = BP_NEXT(r);
+  } else {
+    l->keys[l->n] = p->keys[i];
+    memcpy(l->keys + l->n + 1, r->keys, r->n * sizeof(rbtree_key_t));
+    memcpy(l->child + l->n + 1, r->child, (r->n + 1) * sizeof(bp_node *));
+    l->n += r->n + 1;
+  }
+  free(r);
+  memmove(p->keys + i, p->keys + i + 1, (p->n - i - 1) * sizeof(rbtree_key_t));
+  memmove(p->child + i + 1, p->child + i + 2, (p->n - i - 1) * sizeof(bp_node *));
+  p->n--;
+}
+
+// Restores the minimum fill of p->child[i] by borrowing from or merging with
+// a sibling
+static void bp_fix_underflow(bp_node *p, const int i) {
+  bp_node *c = p->child[i];
+  bp_node *l = i > 0 ? p->child[i - 1] : NULL;
+  bp_node *r = i < p->n ? p->child[i + 1] : NULL;
+
+  if (l != NULL && l->n > BP_MIN) {
+    memmove(c->keys + 1, c->keys, c->n * sizeof(rbtree_key_t));
+    if (c->leaf) {
+      c->keys[0] = l->keys[--l->n];
+      p->keys[i - 1] = c->keys[0];
+    } else {
+      memmove(c->child + 1, c->child, (c->n + 1) * sizeof(bp_node *));
+      c->keys[0] = p->keys[i - 1];
+      c->child[0] = l->child[l->n];
+      p->keys[i - 1] = l->keys[--l->n];
+    }
+    c->n++;
+  } else if (r != NULL && r->n > BP_MIN) {
+    if (c->leaf) {
+      c->keys[c->n++] = r->keys[0];
+      memmove(r->keys, r->keys + 1, (r->n - 1) * sizeof(rbtree_key_t));
+      r->n--;
+      p->keys[i] = r->keys[0];
+    } else {
+      c->keys[c->n] = p->keys[i];
+      c->child[c->n + 1] = r->child[0];
+      c->n++;
+      p->keys[i] = r->keys[0];
+      memmove(r->keys, r->keys + 1, (r->n - 1) * sizeof(rbtree_key_t));
+      memmove(r->child, r->child + 1, r->n * sizeof(bp_node *));
+      r->n--;
+    }
+  } else if (l != NULL) {
+    bp_merge(p, i - 1);
+  } else if (r != NULL) {
+    bp_merge(p, i);
+  }
+}
+
+static int bp_erase_rec(bp_node *x, const rbtree_key_t k) {
+  if (x->leaf) {
+    const int i = (int)lower_bound(x->keys, x->n, k);
+    if (i == x->n || x->keys[i] != k) {
+      return -1;
+    }
+    memmove(x->keys + i, x->keys + i + 1, (x->n - i - 1) * sizeof(rbtree_key_t));
+    x->n--;
+    return 0;
+  }
+  const int i = bp_child_index(x, k);
+  if (bp_erase_rec(x->child[i], k) != 0) {
+    return -1;
+  }
+  if (x->child[i]->n < BP_MIN) {
+    bp_fix_underflow(x, i);
+  }
+  return 0;
+}
+
+static int bp_erase(void *s, const rbtree_key_t k) {
+  bptree_t *t = s;
+  if (bp_erase_rec(t->root, k) != 0) {
+    return -1;
+  }
+  if (!t->root->leaf && t->root->n == 0) {
+    bp_node *old = t->root;
+    t->root = old->child[0];
+    free(old);
+  }
+  return 0;
+}
+
+static bp_node *bp_first_leaf(const bptree_t *t) {
+  bp_node *x = t->root;
+  while (!x->leaf) {
+    x = x->child[0];
+  }
+  return x;
+}
+
+static int bp_pop_min(void *s, rbtree_key_t *k) {
+  const bp_node *x = bp_first_leaf(s);
+  if (x->n == 0) {
+    return -1;
+  }
+  *k = x->keys[0];
+  return bp_erase(s, *k);
+}
+
+static size_t bp_scan(void *s) {
+  size_t n = 0;
+  int64_t sum = 0;
+  for (const bp_node *x = bp_first_leaf(s); x != NULL; x = BP_NEXT(x)) {
+    for (int i = 0; i < x->n; i++) {
+      sum += x->keys[i];
+    }
+    n += x->n;
+  }
+  scan_sink = sum;
+  return n;
+}
+
+/* open-addressing hash (linear probing, backward-shift deletion) */
+
+#define HASH_EMPTY RBTREE_KEY_MIN  // never generated as a workload key
+
+typedef struct {
+  rbtree_key_t *slots;
+  size_t count;
+  int bits;  // capacity is 1 << bits
+} hash_t;
+
+static size_t hash_slot(const rbtree_key_t k, const int bits) {
+  return (size_t)(((uint64_t)(uint32_t)k * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+}
+
+static rbtree_key_t *hash_alloc(const int bits) {
+  const size_t cap = (size_t)1 << bits;
+  rbtree_key_t *slots = malloc(cap * sizeof(rbtree_key_t));
+  if (slots != NULL) {
+    for (size_t i = 0; i < cap; i++) {
+      slots[i] = HASH_EMPTY;
+    }
+  }
+  return slots;
+}
+
+static void *hash_create(void) {
+  hash_t *h = malloc(sizeof(hash_t));
+  if (h == NULL) {
+    return NULL;
+  }
+  h->bits = 4;
+  h->count = 0;
+  h->slots = hash_alloc(h->bits);
+  if (h->slots == NULL) {
+    free(h);
+    return NULL;
+  }
+  return h;
+}
+
+static void hash_destroy(void *s) {
+  hash_t *h = s;
+  free(h->slots);
+  free(h);
+}
+
+static void hash_place(rbtree_key_t *slots, const int bits, const rbtree_key_t k) {
+  const size_t mask = ((size_t)1 << bits) - 1;
+  size_t i = hash_slot(k, bits);
+  while (slots[i] != HASH_EMPTY) {
+    i = (i + 1) & mask;
+  }
+  slots[i] = k;
+}
+
+static int hash_insert(void *s, const rbtree_key_t k) {
+  hash_t *h = s;
+  // keep the load factor at or below 0.7
+  if ((h->count + 1) * 10 > ((size_t)7 << h->bits)) {
+    rbtree_key_t *slots = hash_alloc(h->bits + 1);
+    if (slots == NULL) {
+      return -1;
+    }
+    for (size_t i = 0; i < ((size_t)1 << h->bits); i++) {
+      if (h->slots[i] != HASH_EMPTY) {
+        hash_place(slots, h->bits + 1, h->slots[i]);
+      }
+    }
+    free(h->slots);
+    h->slots = slots;
+    h->bits++;
+  }
+
+  const size_t mask = ((size_t)1 << h->bits) - 1;
+  size_t i = hash_slot(k, h->bits);
+  while (h->slots[i] != HASH_EMPTY) {
+    if (h->slots[i] == k) {
+      return -1;
+    }
+    i = (i + 1) & mask;
+  }
+  h->slots[i] = k;
+  h->count++;
+  return 0;
+}
+
+static int hash_find(void *s, const rbtree_key_t k) {
+  const hash_t *h = s;
+  const size_t mask = ((size_t)1 << h->bits) - 1;
+  for (size_t i = hash_slot(k, h->bits); h->slots[i] != HASH_EMPTY;
+       i = (i + 1) & mask) {
+    if (h->slots[i] == k) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int hash_erase(void *s, const rbtree_key_t k) {
+  hash_t *h = s;
+  const size_t mask = ((size_t)1 << h->bits) - 1;
+  size_t i = hash_slot(k, h->bits);
+  while (h->slots[i] != k) {
+    if (h->slots[i] == HASH_EMPTY) {
+      return -1;
+    }
+    i = (i + 1) & mask;
+  }
+  // Pull back later entries of the cluster whose home slot is not in (i, j]
+  for (size_t j = (i + 1) & mask; h->slots[j] != HASH_EMPTY; j = (j + 1) & mask) {
+    const size_t home = hash_slot(h->slots[j], h->bits);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      h->slots[i] = h->slots[j];
+      i = j;
+    }
+  }
+  h->slots[i] = HASH_EMPTY;
+  h->count--;
+  return 0;
+}
+
+/* binary min-heap */
+
+typedef struct {
+  rbtree_key_t *keys;
+  size_t count, cap;
+} heap_t;
+
+static void *heap_create(void) { return calloc(1, sizeof(heap_t)); }
+
+static void heap_destroy(void *s) {
+  heap_t *h = s;
+  free(h->keys);
+  free(h);
+}
+
+static int heap_insert(void *s, const rbtree_key_t k) {
+  heap_t *h = s;
+  if (h->count == h->cap) {
+    const size_t cap = h->cap == 0 ? 16 : h->cap * 2;
+    rbtree_key_t *keys = realloc(h->keys, cap * sizeof(rbtree_key_t));
+    if (keys == NULL) {
+      return -1;
+    }
+    h->keys = keys;
+    h->cap = cap;
+  }
+  size_t i = h->count++;
+  while (i > 0 && h->keys[(i - 1) / 2] > k) {
+    h->keys[i] = h->keys[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  h->keys[i] = k;
+  return 0;
+}
+
+static int heap_pop_min(void *s, rbtree_key_t *k) {
+  heap_t *h = s;
+  if (h->count == 0) {
+    return -1;
+  }
+  *k = h->keys[0];
+  const rbtree_key_t last = h->keys[--h->count];
+  size_t i = 0;
+  for (;;) {
+    size_t c = 2 * i + 1;
+    if (c >= h->count) {
+      break;
+    }
+    if (c + 1 < h->count && h->keys[c + 1] < h->keys[c]) {
+      c++;
+    }
+    if (h->keys[c] >= last) {
+      break;
+    }
+    h->keys[i] = h->keys[c];
+    i = c;
+  }
+  h->keys[i] = last;
+  return 0;
+}
+
+static const structure_t structures[] = {
+    {"rbtree", CAP_POINT | CAP_ORDERED | CAP_PQ, 0, rb_create, rb_destroy,
+     rb_insert, NULL, rb_find, rb_erase, rb_pop_min, rb_scan},
+    {"bucket_tree", CAP_POINT | CAP_ORDERED | CAP_PQ, 0, bt_create, bt_destroy,
+     bt_insert, NULL, bt_find, bt_erase, bt_pop_min, bt_scan},
+    // one-at-a-time inserts are O(n) memmoves, so large sizes are bulk-loaded
+    {"sorted_vector", CAP_POINT | CAP_ORDERED | CAP_PQ, 100000, vec_create,
+     vec_destroy, vec_insert, vec_bulk, vec_find, vec_erase, vec_pop_min,
+     vec_scan},
+    {"skiplist", CAP_POINT | CAP_ORDERED | CAP_PQ, 0, skip_create,
+     skip_destroy, skip_insert, NULL, skip_find, skip_erase, skip_pop_min,
+     skip_scan},
+    {"bptree", CAP_POINT | CAP_ORDERED | CAP_PQ, 0, bp_create, bp_destroy,
+     bp_insert, NULL, bp_find, bp_erase, bp_pop_min, bp_scan},
+    {"hash", CAP_POINT, 0, hash_create, hash_destroy, hash_insert, NULL,
+     hash_find, hash_erase, NULL, NULL},
+    {"heap", CAP_PQ, 0, heap_create, heap_destroy, heap_insert, NULL, NULL,
+     NULL, heap_pop_min, NULL},
+};
+
+#define N_STRUCTURES (sizeof(structures) / sizeof(structures[0]))
+
+/* workload */
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Bytes currently allocated through malloc, including allocator overhead
+static size_t heap_in_use(void) {
+  const struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+}
+
+// 2n distinct keys: the first n are inserted, the rest are guaranteed misses.
+// The 32-bit mix is a bijection, so keys stay distinct for any n < 2^31.
+static rbtree_key_t *make_keys(const size_t n, const unsigned seed) {
+  rbtree_key_t *keys = malloc(2 * n * sizeof(rbtree_key_t));
+  if (keys == NULL) {
+    return NULL;
+  }
+  uint32_t i = 0;
+  for (size_t j = 0; j < 2 * n; i++) {
+    uint32_t x = (i + seed * 0x632BE5ABu) * 0x9E3779B1u;
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    if ((rbtree_key_t)x != HASH_EMPTY) {
+      keys[j++] = (rbtree_key_t)x;
+    }
+  }
+  return keys;
+}
+
+// Fisher-Yates with a fixed seed so every structure sees the same order
+static void shuffle(rbtree_key_t *keys, const size_t n, uint64_t rng) {
+  for (size_t i = n; i > 1; i--) {
+    rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+    const size_t j = (size_t)((rng >> 33) % i);
+    const rbtree_key_t tmp = keys[i - 1];
+    keys[i - 1] = keys[j];
+    keys[j] = tmp;
+  }
+}
+
+typedef enum { OP_INSERT, OP_FIND, OP_MISS, OP_ERASE, OP_POP_MIN } op_t;
+
+static const char *op_names[] = {"insert", "find", "miss", "erase", "pop_min"};
+
+// Returns 0 when the operation had the expected outcome
+static inline int apply(const structure_t *st, void *ds, const op_t op,
+                        const rbtree_key_t k) {
+  rbtree_key_t out;
+  switch (op) {
+    case OP_INSERT:
+      return st->insert(ds, k);
+    case OP_FIND:
+      return !st->find(ds, k);
+    case OP_MISS:
+      return st->find(ds, k);
+    case OP_ERASE:
+      return st->erase(ds, k);
+    default:
+      return st->pop_min(ds, &out);
+  }
+}
+
+#define LATENCY_SAMPLES 65536
+
+static int comp_u64(const void *p1, const void *p2) {
+  const uint64_t a = *(const uint64_t *)p1, b = *(const uint64_t *)p2;
+  return a < b ? -1 : a > b;
+}
+
+static uint64_t timer_overhead_ns;
+
+typedef struct {
+  size_t ops;
+  uint64_t ns;
+  size_t samples;  // 0 when the phase was timed as a whole only
+  uint64_t p50, p99, p999, max;
+} result_t;
+
+static void print_row(const structure_t *st, const size_t n, const char *phase,
+                      const result_t *r, const double bytes_per_key) {
+  printf("%s,%zu,%s,%zu,%.6f,%.0f,%.1f", st->name, n, phase, r->ops,
+         r->ns * 1e-9, r->ns == 0 ? 0 : r->ops * 1e9 / r->ns, bytes_per_key);
+  if (r->samples == 0) {
+    printf(",,,,\n");
+  } else {
+    printf(",%llu,%llu,%llu,%llu\n", (unsigned long long)r->p50,
+           (unsigned long long)r->p99, (unsigned long long)r->p999,
+           (unsigned long long)r->max);
+  }
+}
+
+// Runs one phase over keys[0..ops). Every stride-th operation is timed on its
+// own for the latency percentiles; throughput comes from the whole loop.
+static int run_phase(const structure_t *st, void *ds, const op_t op,
+                     const rbtree_key_t *keys, const size_t ops, result_t *r) {
+  const size_t stride = ops / LATENCY_SAMPLES + 1;
+  uint64_t *lat = malloc((ops / stride + 1) * sizeof(uint64_t));
+  if (lat == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return -1;
+  }
+
+  size_t bad = 0, m = 0, countdown = 0;
+  const uint64_t start = now_ns();
+  for (size_t i = 0; i < ops; i++) {
+    const rbtree_key_t k = op == OP_POP_MIN ? 0 : keys[i];
+    if (countdown-- == 0) {
+      countdown = stride - 1;
+      const uint64_t t0 = now_ns();
+      bad += apply(st, ds, op, k) != 0;
+      const uint64_t dt = now_ns() - t0;
+      lat[m++] = dt > timer_overhead_ns ? dt - timer_overhead_ns : 0;
+    } else {
+      bad += apply(st, ds, op, k) != 0;
+    }
+  }
+  r->ns = now_ns() - start;
+  r->ops = ops;
+  r->samples = m;
+
+  if (m > 0) {
+    qsort(lat, m, sizeof(uint64_t), comp_u64);
+    r->p50 = lat[m / 2];
+    r->p99 = lat[m * 99 / 100];
+    r->p999 = lat[m * 999 / 1000];
+    r->max = lat[m - 1];
+  }
+  free(lat);
+  if (bad != 0) {
+    fprintf(stderr, "%s: %zu unexpected results in %s\n", st->name, bad,
+            op_names[op]);
+    return -1;
+  }
+  return 0;
+}
+
+// Phases: insert (or bulk), find, miss, scan, erase half, pop_min the rest.
+// bytes/key is the malloc footprint (allocator overhead included) after the
+// keys are loaded.
+static int run_structure(const structure_t *st, const size_t n,
+                         const unsigned seed) {
+  rbtree_key_t *keys = make_keys(n, seed);
+  if (keys == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return -1;
+  }
+
+  const size_t before = heap_in_use();
+  void *ds = st->create();
+  if (ds == NULL) {
+    free(keys);
+    fprintf(stderr, "out of memory\n");
+    return -1;
+  }
+
+  result_t r;
+  int ret = 0;
+  const int mutable = st->max_mutate == 0 || n <= st->max_mutate;
+  if (mutable) {
+    ret = run_phase(st, ds, OP_INSERT, keys, n, &r);
+  } else {
+    const uint64_t start = now_ns();
+    ret = st->bulk(ds, keys, n);
+    r.ns = now_ns() - start;
+    r.ops = n;
+    r.samples = 0;
+  }
+  const double bytes_per_key = (double)(heap_in_use() - before) / n;
+  print_row(st, n, mutable ? "insert" : "bulk", &r, bytes_per_key);
+
+  // look keys up in a different order than they were inserted
+  shuffle(keys, n, seed);
+  if (ret == 0 && (st->caps & CAP_POINT)) {
+    ret = run_phase(st, ds, OP_FIND, keys, n, &r);
+    print_row(st, n, "find", &r, bytes_per_key);
+  }
+  if (ret == 0 && (st->caps & CAP_POINT)) {
+    ret = run_phase(st, ds, OP_MISS, keys + n, n, &r);
+    print_row(st, n, "miss", &r, bytes_per_key);
+  }
+  if (ret == 0 && (st->caps & CAP_ORDERED)) {
+    const uint64_t start = now_ns();
+    r.ops = st->scan(ds);
+    r.ns = now_ns() - start;
+    r.samples = 0;
+    print_row(st, n, "scan", &r, bytes_per_key);
+    if (r.ops != n) {
+      fprintf(stderr, "%s: scan visited %zu of %zu keys\n", st->name, r.ops,
+              n);
+      ret = -1;
+    }
+  }
+  size_t left = n;
+  if (ret == 0 && mutable && (st->caps & CAP_POINT)) {
+    ret = run_phase(st, ds, OP_ERASE, keys, n / 2, &r);
+    print_row(st, n, "erase", &r, bytes_per_key);
+    left -= n / 2;
+  }
+  if (ret == 0 && mutable && (st->caps & CAP_PQ)) {
+    ret = run_phase(st, ds, OP_POP_MIN, NULL, left, &r);
+    print_row(st, n, "pop_min", &r, bytes_per_key);
+  }
+  fflush(stdout);
+
+  st->destroy(ds);
+  free(keys);
+  return ret;
+}
+
+// Median cost of an empty now_ns() pair, subtracted from latency samples
+static uint64_t measure_timer_overhead(void) {
+  uint64_t lat[1001];
+  for (size_t i = 0; i < 1001; i++) {
+    const uint64_t t0 = now_ns();
+    lat[i] = now_ns() - t0;
+  }
+  qsort(lat, 1001, sizeof(uint64_t), comp_u64);
+  return lat[500];
+}
+
+// Whether name appears in the comma-separated list (NULL selects everything)
+static int selected(const char *list, const char *name) {
+  if (list == NULL) {
+    return 1;
+  }
+  const size_t len = strlen(name);
+  for (const char *p = list; *p != '\0';) {
+    const char *end = strchr(p, ',');
+    const size_t n = end == NULL ? strlen(p) : (size_t)(end - p);
+    if (n == len && strncmp(p, name, len) == 0) {
+      return 1;
+    }
+    p += n + (end != NULL);
+  }
+  return 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-n keys | -m max_keys] [-S structures] [-s seed]\n"
+          "  -n  run a single size\n"
+          "  -m  sweep 1K, 10K, ... up to max_keys (default 1000000;\n"
+          "      100000000 for the full sweep)\n"
+          "  -S  comma-separated subset of:",
+          prog);
+  for (size_t i = 0; i < N_STRUCTURES; i++) {
+    fprintf(stderr, " %s", structures[i].name);
+  }
+  fprintf(stderr,
+          "\n"
+          "CSV columns: structure,n,phase,ops,seconds,ops_per_sec,"
+          "bytes_per_key,p50_ns,p99_ns,p999_ns,max_ns\n");
+}
+
+int main(int argc, char *argv[]) {
+  size_t single = 0;
+  size_t max_n = 1000000;
+  const char *only = NULL;
+  unsigned seed = 17;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:m:S:s:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        single = strtoull(optarg, NULL, 10);
+        break;
+      case 'm':
+        max_n = strtoull(optarg, NULL, 10);
+        break;
+      case 'S':
+        only = optarg;
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (max_n < 1000 || (size_t)INT_MAX < (single != 0 ? single : max_n)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  timer_overhead_ns = measure_timer_overhead();
+  printf("structure,n,phase,ops,seconds,ops_per_sec,bytes_per_key,"
+         "p50_ns,p99_ns,p999_ns,max_ns\n");
+
+  for (size_t n = single != 0 ? single : 1000; n <= (single != 0 ? single : max_n);
+       n *= 10) {
+    for (size_t i = 0; i < N_STRUCTURES; i++) {
+      if (selected(only, structures[i].name) &&
+          run_structure(&structures[i], n, seed) != 0) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
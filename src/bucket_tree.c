@@ -0,0 +1,380 @@
+#include "bucket_tree.h"
+#include "rbtree_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+int bucket_lower_bound(const bucket_t *b, const rbtree_key_t key);
+bucket_t *bucket_locate(const bucket_tree *t, const rbtree_key_t key);
+bucket_t *bucket_next(const bucket_tree *t, bucket_t *b);
+bucket_t *bucket_prev(const bucket_tree *t, bucket_t *b);
+bucket_t *bucket_new(bucket_tree *t);
+void bucket_remove(bucket_tree *t, bucket_t *b);
+bucket_t *bucket_split(bucket_tree *t, bucket_t *b);
+void bucket_rebalance(bucket_tree *t, bucket_t *b);
+
+/*
+🪣 bucket 트리 구조체 생성 함수
+*/
+bucket_tree *new_bucket_tree(void)
+{
+  bucket_tree *p = (bucket_tree *)calloc(1, sizeof(bucket_tree));
+  if (p == NULL)
+  {
+    return NULL;
+  }
+
+  p->index = new_rbtree();
+  if (p->index == NULL)
+  {
+    free(p);
+    return NULL;
+  }
+
+  return p;
+}
+
+/*
+🪣 bucket 트리가 사용했던 메모리를 모두 반환하는 함수
+node가 bucket의 첫 번째 멤버이므로 인덱스 트리의 노드를 해제하면 bucket이 해제됨
+*/
+void delete_bucket_tree(bucket_tree *t)
+{
+  delete_rbtree(t->index);
+  free(t);
+}
+
+/*
+🪣 bucket 안에서 key보다 작은 값의 개수(= key가 들어갈 위치)를 구하는 함수
+정렬된 배열이므로 SIMD로 여러 개를 한 번에 비교하다가 전부 작지 않은 묶음에서 멈춤
+*/
+int bucket_lower_bound(const bucket_t *b, const rbtree_key_t key)
+{
+  int i = 0;
+#if defined(RBTREE_KEY64)
+#if defined(__AVX2__)
+  // 64비트 key는 AVX2로 4개씩 비교 (SSE2에는 64비트 비교가 없어 스칼라로 처리)
+  const __m256i k = _mm256_set1_epi64x(key);
+  for (; i + 4 <= b->count; i += 4)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)&b->keys[i]);
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v)));
+    if (mask != 0xF)
+    {
+      return i + __builtin_popcount(mask);
+    }
+  }
+#endif
+#elif defined(__AVX2__)
+  const __m256i k = _mm256_set1_epi32(key);
+  for (; i + 8 <= b->count; i += 8)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)&b->keys[i]);
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)));
+    if (mask != 0xFF)
+    {
+      return i + __builtin_popcount(mask);
+    }
+  }
+#elif defined(__SSE2__)
+  const __m128i k = _mm_set1_epi32(key);
+  for (; i + 4 <= b->count; i += 4)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)&b->keys[i]);
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, k)));
+    if (mask != 0xF)
+    {
+      return i + __builtin_popcount(mask);
+    }
+  }
+#endif
+  // SIMD 폭에 맞지 않는 나머지 원소들
+  while (i < b->count && b->keys[i] < key)
+  {
+    i++;
+  }
+  return i;
+}
+
+/*
+🪣 key를 찾기 시작할 bucket을 반환하는 함수
+구분값이 key보다 작은 bucket 중 가장 오른쪽 bucket, 없으면 첫 번째 bucket
+구분값이 key와 같은 bucket들은 모두 이 bucket 뒤에 있으므로 key의 첫 위치는 여기서부터 오른쪽으로 찾으면 됨
+*/
+bucket_t *bucket_locate(const bucket_tree *t, const rbtree_key_t key)
+{
+  const rbtree *index = t->index;
+  node_t *curr = index->root;
+  node_t *found = NULL;
+  while (curr != index->nil)
+  {
+    if (curr->key < key)
+    {
+      found = curr;
+      curr = curr->right;
+    }
+    else
+    {
+      curr = curr->left;
+    }
+  }
+
+  if (found == NULL)
+  {
+    found = rbtree_min(index);
+    if (found == index->nil)
+    {
+      return NULL;
+    }
+  }
+  return (bucket_t *)found;
+}
+
+/*
+🪣 key 순서상 다음/이전 bucket을 반환하는 함수 (없으면 NULL)
+*/
+bucket_t *bucket_next(const bucket_tree *t, bucket_t *b)
+{
+  return (bucket_t *)rbtree_next(t->index, &b->node);
+}
+
+bucket_t *bucket_prev(const bucket_tree *t, bucket_t *b)
+{
+  return (bucket_t *)rbtree_prev(t->index, &b->node);
+}
+
+/*
+🪣 빈 bucket을 할당하는 함수 (인덱스 연결은 호출하는 쪽에서 구분값을 정한 뒤 수행)
+*/
+bucket_t *bucket_new(bucket_tree *t)
+{
+  bucket_t *b = (bucket_t *)malloc(sizeof(bucket_t));
+  if (b == NULL)
+  {
+    return NULL;
+  }
+  b->count = 0;
+  return b;
+}
+
+/*
+🪣 bucket을 인덱스에서 떼어내고 메모리를 반환하는 함수
+*/
+void bucket_remove(bucket_tree *t, bucket_t *b)
+{
+  rbtree_unlink_node(t->index, &b->node);
+  free(b);
+}
+
+/*
+🪣 가득 찬 bucket의 뒤쪽 절반을 새 bucket으로 옮기는 함수
+새 bucket의 구분값은 옮겨간 key 중 가장 작은 값 (같은 key가 길게 이어지면 앞 bucket과 같을 수 있음)
+*/
+bucket_t *bucket_split(bucket_tree *t, bucket_t *b)
+{
+  bucket_t *right = bucket_new(t);
+  if (right == NULL)
+  {
+    return NULL;
+  }
+
+  const int half = b->count / 2;
+  right->count = b->count - half;
+  memcpy(right->keys, b->keys + half, right->count * sizeof(rbtree_key_t));
+  b->count = half;
+
+  right->node.key = right->keys[0];
+#ifdef RBTREE_INTERVAL
+  right->node.high = RBTREE_KEY_MIN; // 인덱스는 구간 질의를 쓰지 않음
+#endif
+  // 구분값이 같은 bucket이 여럿일 수 있으므로 key로 자리를 찾지 않고 b 바로 뒤에 연결
+  rbtree_link_after(t->index, &b->node, &right->node);
+  return right;
+}
+
+/*
+🪣 삭제 후 bucket이 비었거나 너무 작아지면 제거하거나 이웃 bucket과 합치는 함수
+왼쪽 bucket이 오른쪽 bucket을 흡수하므로 구분값은 바꾸지 않아도 순서가 유지됨
+*/
+void bucket_rebalance(bucket_tree *t, bucket_t *b)
+{
+  if (b->count == 0)
+  {
+    bucket_remove(t, b);
+    return;
+  }
+  if (b->count >= BUCKET_CAPACITY / 4)
+  {
+    return;
+  }
+
+  bucket_t *next = bucket_next(t, b);
+  if (next != NULL && b->count + next->count <= BUCKET_CAPACITY * 3 / 4)
+  {
+    memcpy(b->keys + b->count, next->keys, next->count * sizeof(rbtree_key_t));
+    b->count += next->count;
+    bucket_remove(t, next);
+    return;
+  }
+
+  bucket_t *prev = bucket_prev(t, b);
+  if (prev != NULL && prev->count + b->count <= BUCKET_CAPACITY * 3 / 4)
+  {
+    memcpy(prev->keys + prev->count, b->keys, b->count * sizeof(rbtree_key_t));
+    prev->count += b->count;
+    bucket_remove(t, b);
+  }
+}
+
+/*
+🪣 bucket 트리에 key를 삽입하는 함수 (성공하면 0, 메모리 할당에 실패하면 -1)
+*/
+int bucket_tree_insert(bucket_tree *t, const rbtree_key_t key)
+{
+  bucket_t *b = bucket_locate(t, key);
+
+  // 트리가 비어있으면 첫 bucket 생성
+  if (b == NULL)
+  {
+    b = bucket_new(t);
+    if (b == NULL)
+    {
+      return -1;
+    }
+    b->node.key = key;
+#ifdef RBTREE_INTERVAL
+    b->node.high = RBTREE_KEY_MIN;
+#endif
+    rbtree_link_node(t->index, &b->node);
+  }
+
+  // 첫 번째 bucket보다 작은 key라면 구분값을 낮춤 (최소 노드라서 인덱스 순서는 유지됨)
+  if (key < b->node.key)
+  {
+    b->node.key = key;
+  }
+
+  // bucket이 가득 찬 경우 반으로 나누고 key가 들어갈 쪽 선택
+  if (b->count == BUCKET_CAPACITY)
+  {
+    bucket_t *right = bucket_split(t, b);
+    if (right == NULL)
+    {
+      return -1;
+    }
+    if (key >= right->node.key)
+    {
+      b = right;
+    }
+  }
+
+  const int pos = bucket_lower_bound(b, key);
+  memmove(b->keys + pos + 1, b->keys + pos, (b->count - pos) * sizeof(rbtree_key_t));
+  b->keys[pos] = key;
+  b->count++;
+  t->size++;
+  return 0;
+}
+
+/*
+🪣 key가 저장된 위치를 반환하는 함수 (없으면 NULL)
+반환된 포인터는 다음 삽입/삭제 전까지만 유효함
+*/
+const rbtree_key_t *bucket_tree_find(const bucket_tree *t, const rbtree_key_t key)
+{
+  bucket_t *b = bucket_locate(t, key);
+  while (b != NULL)
+  {
+    const int pos = bucket_lower_bound(b, key);
+    if (pos < b->count)
+    {
+      return b->keys[pos] == key ? &b->keys[pos] : NULL;
+    }
+    // bucket의 모든 key가 더 작으면 다음 bucket의 앞부분에 있을 수 있음
+    b = bucket_next(t, b);
+  }
+  return NULL;
+}
+
+/*
+🪣 최소값/최대값의 위치를 반환하는 함수 (트리가 비어있으면 NULL)
+*/
+const rbtree_key_t *bucket_tree_min(const bucket_tree *t)
+{
+  node_t *p = rbtree_min(t->index);
+  if (p == t->index->nil)
+  {
+    return NULL;
+  }
+  return &((bucket_t *)p)->keys[0];
+}
+
+const rbtree_key_t *bucket_tree_max(const bucket_tree *t)
+{
+  node_t *p = rbtree_max(t->index);
+  if (p == t->index->nil)
+  {
+    return NULL;
+  }
+  bucket_t *b = (bucket_t *)p;
+  return &b->keys[b->count - 1];
+}
+
+/*
+🪣 key 하나를 삭제하는 함수 (삭제했으면 0, 없으면 -1)
+*/
+int bucket_tree_erase(bucket_tree *t, const rbtree_key_t key)
+{
+  bucket_t *b = bucket_locate(t, key);
+  while (b != NULL)
+  {
+    const int pos = bucket_lower_bound(b, key);
+    if (pos < b->count)
+    {
+      if (b->keys[pos] != key)
+      {
+        return -1;
+      }
+      memmove(b->keys + pos, b->keys + pos + 1, (b->count - pos - 1) * sizeof(rbtree_key_t));
+      b->count--;
+      t->size--;
+      bucket_rebalance(t, b);
+      return 0;
+    }
+    b = bucket_next(t, b);
+  }
+  return -1;
+}
+
+/*
+🪣 bucket 트리를 오름차순 배열로 변환하고 쓴 key 수를 반환하는 함수 (최대 n개)
+bucket 단위로 연속 복사하므로 노드마다 포인터를 따라가지 않음
+*/
+size_t bucket_tree_to_array(const bucket_tree *t, rbtree_key_t *arr, const size_t n)
+{
+  size_t order = 0;
+  node_t *p = rbtree_min(t->index);
+  if (p == t->index->nil)
+  {
+    return 0;
+  }
+
+  while (p != NULL && order < n)
+  {
+    bucket_t *b = (bucket_t *)p;
+    size_t len = b->count;
+    if (len > n - order)
+    {
+      len = n - order;
+    }
+    memcpy(arr + order, b->keys, len * sizeof(rbtree_key_t));
+    order += len;
+    p = rbtree_next(t->index, p);
+  }
+  return order;
+}
@@ -0,0 +1,33 @@
+#ifndef _BUCKET_TREE_H_
+#define _BUCKET_TREE_H_
+
+#include "rbtree.h"
+
+#define BUCKET_CAPACITY 32
+
+// 정렬된 key 배열을 담는 leaf bucket
+// node는 반드시 첫 번째 멤버여야 함 (인덱스 트리의 노드 포인터 == bucket 포인터)
+typedef struct bucket_t {
+  node_t node;  // node.key는 bucket의 구분값(separator)
+  int count;
+  rbtree_key_t keys[BUCKET_CAPACITY];
+} bucket_t;
+
+// bucket 구분값을 key로 하는 RB 트리 인덱스 + leaf bucket들
+typedef struct {
+  rbtree *index;
+  size_t size;
+} bucket_tree;
+
+bucket_tree *new_bucket_tree(void);
+void delete_bucket_tree(bucket_tree *);
+
+int bucket_tree_insert(bucket_tree *, const rbtree_key_t);
+const rbtree_key_t *bucket_tree_find(const bucket_tree *, const rbtree_key_t);
+const rbtree_key_t *bucket_tree_min(const bucket_tree *);
+const rbtree_key_t *bucket_tree_max(const bucket_tree *);
+int bucket_tree_erase(bucket_tree *, const rbtree_key_t);
+
+size_t bucket_tree_to_array(const bucket_tree *, rbtree_key_t *, const size_t);
+
+#endif  // _BUCKET_TREE_H_
@@ -1,5 +1,624 @@
 #include "rbtree.h"
+#include "rbtree_trace.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Hardware counters sampled around each workload phase (-p)
+typedef struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} counter_def_t;
+
+#define HW_CACHE_MISS(cache)                                   \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |              \
+   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const counter_def_t counter_defs[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instr", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1d-miss", PERF_TYPE_HW_CACHE, HW_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {"LLC-miss", PERF_TYPE_HW_CACHE, HW_CACHE_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {"dTLB-miss", PERF_TYPE_HW_CACHE, HW_CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {"br-miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+#define N_COUNTERS (sizeof(counter_defs) / sizeof(counter_defs[0]))
+
+typedef struct {
+  int fd[N_COUNTERS];  // -1 when the counter is not permitted/supported
+  int available;       // number of counters that opened
+} profiler_t;
+
+typedef struct {
+  double seconds;
+  double count[N_COUNTERS];  // scaled for multiplexing, < 0 when unavailable
+} sample_t;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void profiler_open(profiler_t *prof) {
+  prof->available = 0;
+  for (size_t i = 0; i < N_COUNTERS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter_defs[i].type;
+    attr.config = counter_defs[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // Count threads created after this point too (the -t workers of the
+    // parallel export/build phases); reads sum over all of them.
+    attr.inherit = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    prof->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (prof->fd[i] >= 0) {
+      prof->available++;
+    }
+  }
+  if (prof->available == 0) {
+    fprintf(stderr,
+            "perf_event_open unavailable (%s), falling back to timer only\n",
+            strerror(errno));
+  }
+}
+
+static void profiler_close(profiler_t *prof) {
+  for (size_t i = 0; i < N_COUNTERS; i++) {
+    if (prof->fd[i] >= 0) {
+      close(prof->fd[i]);
+    }
+  }
+}
+
+static void profiler_start(profiler_t *prof, sample_t *s) {
+  for (size_t i = 0; i < N_COUNTERS; i++) {
+    if (prof->fd[i] >= 0) {
+      ioctl(prof->fd[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(prof->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  s->seconds = now_seconds();
+}
+
+static void profiler_stop(profiler_t *prof, sample_t *s) {
+  s->seconds = now_seconds() - s->seconds;
+  for (size_t i = 0; i < N_COUNTERS; i++) {
+    s->count[i] = -1;
+    if (prof->fd[i] < 0) {
+      continue;
+    }
+    ioctl(prof->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t v[3];  // value, time enabled, time running
+    if (read(prof->fd[i], v, sizeof(v)) == sizeof(v) && v[2] > 0) {
+      s->count[i] = (double)v[0] * v[1] / v[2];
+    }
+  }
+}
+
+static void print_header(const profiler_t *prof) {
+  printf("%-10s %12s %12s", "phase", "ops", "ns/op");
+  if (prof != NULL) {
+    for (size_t i = 0; i < N_COUNTERS; i++) {
+      printf(" %10s", counter_defs[i].name);
+    }
+  }
+  printf("\n");
+}
+
+static void print_sample(const char *phase, const size_t ops,
+                         const sample_t *s, const profiler_t *prof) {
+  printf("%-10s %12zu %12.1f", phase, ops, s->seconds * 1e9 / ops);
+  if (prof != NULL) {
+    for (size_t i = 0; i < N_COUNTERS; i++) {
+      if (s->count[i] < 0) {
+        printf(" %10s", "n/a");
+      } else {
+        printf(" %10.2f", s->count[i] / ops);
+      }
+    }
+  }
+  printf("\n");
+}
+
+static rbtree_key_t *make_keys(const size_t n, const char *dist, unsigned seed) {
+  rbtree_key_t *keys = malloc(n * sizeof(rbtree_key_t));
+  if (keys == NULL) {
+    return NULL;
+  }
+  srand(seed);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = strcmp(dist, "seq") == 0 ? (rbtree_key_t)i : (rbtree_key_t)rand();
+  }
+  return keys;
+}
+
+// n lookups drawn from keys with Zipf(theta) popularity; the rank order is the
+// (random) order of keys, so hot keys are scattered over the key space.
+// *top_share receives the fraction of lookups that hit the top 1% of keys.
+static rbtree_key_t *make_zipf_lookups(const rbtree_key_t *keys, const size_t n,
+                                const double theta, double *top_share) {
+  double *cdf = malloc(n * sizeof(double));
+  rbtree_key_t *lookups = malloc(n * sizeof(rbtree_key_t));
+  if (cdf == NULL || lookups == NULL) {
+    free(cdf);
+    free(lookups);
+    return NULL;
+  }
+  double sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    sum += 1.0 / pow((double)(i + 1), theta);
+    cdf[i] = sum;
+  }
+  *top_share = n >= 100 ? cdf[n / 100 - 1] / sum : 1;
+  for (size_t i = 0; i < n; i++) {
+    const double u = ((double)rand() + 0.5) / ((double)RAND_MAX + 1) * sum;
+    size_t lo = 0, hi = n - 1;
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (cdf[mid] < u) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    lookups[i] = keys[lo];
+  }
+  free(cdf);
+  return lookups;
+}
+
+// insert, find, to_array and erase phases over the same key set
+static int run_workload(const size_t n, const char *dist, const unsigned seed,
+                        const int threads, const size_t cache_sets,
+                        profiler_t *prof) {
+  rbtree_key_t *keys = make_keys(n, dist, seed);
+  rbtree_key_t *arr = malloc(n * sizeof(rbtree_key_t));
+  rbtree *t = new_rbtree();
+  if (keys == NULL || arr == NULL || t == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  sample_t s;
+  const profiler_t *shown = prof->available ? prof : NULL;
+#ifdef RBTREE_WAVL
+  printf("n=%zu dist=%s threads=%d balance=wavl\n", n, dist, threads);
+#else
+  printf("n=%zu dist=%s threads=%d balance=rb\n", n, dist, threads);
+#endif
+  print_header(shown);
+
+  profiler_start(prof, &s);
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  profiler_stop(prof, &s);
+  print_sample("insert", n, &s, shown);
+
+  size_t found = 0;
+  profiler_start(prof, &s);
+  for (size_t i = 0; i < n; i++) {
+    found += rbtree_find(t, keys[i]) != NULL;
+  }
+  profiler_stop(prof, &s);
+  print_sample("find", n, &s, shown);
+
+  // skewed point lookups, first on the plain tree and then through the
+  // lookup cache (which starts cold)
+  double top_share;
+  rbtree_key_t *zipf = make_zipf_lookups(keys, n, 0.99, &top_share);
+  if (zipf == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  size_t zipf_found = 0;
+  profiler_start(prof, &s);
+  for (size_t i = 0; i < n; i++) {
+    zipf_found += rbtree_find(t, zipf[i]) != NULL;
+  }
+  profiler_stop(prof, &s);
+  print_sample("zipf", n, &s, shown);
+
+  if (rbtree_enable_cache(t, cache_sets != 0 ? cache_sets : n / 64 + 1) != 0) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  profiler_start(prof, &s);
+  for (size_t i = 0; i < n; i++) {
+    zipf_found += rbtree_find(t, zipf[i]) != NULL;
+  }
+  profiler_stop(prof, &s);
+  print_sample("zipf+cache", n, &s, shown);
+  printf("  top 1%% of keys take %.0f%% of zipf lookups; cache %zu sets x %d "
+         "ways, hits %zu, misses %zu (%.1f%% hit)\n",
+         top_share * 100, t->cache->mask + 1, RBTREE_CACHE_WAYS,
+         t->cache->hits, t->cache->misses,
+         100.0 * t->cache->hits / (t->cache->hits + t->cache->misses));
+  rbtree_enable_cache(t, 0);  // later phases measure the plain tree
+  free(zipf);
+
+  profiler_start(prof, &s);
+  rbtree_to_array(t, arr, n);
+  profiler_stop(prof, &s);
+  print_sample("to_array", n, &s, shown);
+
+  // parallel export and balanced rebuild from the exported sorted keys
+  profiler_start(prof, &s);
+  rbtree_to_array_parallel(t, arr, n, threads);
+  profiler_stop(prof, &s);
+  print_sample("to_array/p", n, &s, shown);
+
+  profiler_start(prof, &s);
+  rbtree *b = rbtree_from_sorted_array(arr, n, threads);
+  profiler_stop(prof, &s);
+  print_sample("build/p", n, &s, shown);
+  delete_rbtree(b);
+
+  profiler_start(prof, &s);
+  rbtree *c = rbtree_clone(t);
+  profiler_stop(prof, &s);
+  print_sample("clone", n, &s, shown);
+  profiler_start(prof, &s);
+  delete_rbtree(c);
+  profiler_stop(prof, &s);
+  print_sample("clone-del", n, &s, shown);
+
+  // steady-state churn: every insert is paired with an erase (50% erases)
+  profiler_start(prof, &s);
+  for (size_t i = 0; i < n; i++) {
+    rbtree_erase(t, rbtree_find(t, keys[i]));
+    keys[i] = strcmp(dist, "seq") == 0 ? (rbtree_key_t)(n + i) : (rbtree_key_t)rand();
+    rbtree_insert(t, keys[i]);
+  }
+  profiler_stop(prof, &s);
+  print_sample("mixed", 2 * n, &s, shown);
+
+  profiler_start(prof, &s);
+  for (size_t i = 0; i < n; i++) {
+    rbtree_erase(t, rbtree_find(t, keys[i]));
+  }
+  profiler_stop(prof, &s);
+  print_sample("erase", n, &s, shown);
+  delete_rbtree(t);
+
+  // an erase burst below the tombstone threshold only marks nodes; the
+  // physical removal is paid later by rbtree_compact
+  t = new_lazy_rbtree(0);
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  const size_t burst = n / 5;
+  profiler_start(prof, &s);
+  for (size_t i = 0; i < burst; i++) {
+    rbtree_erase(t, rbtree_find(t, keys[i]));
+  }
+  profiler_stop(prof, &s);
+  print_sample("erase/lazy", burst, &s, shown);
+
+  const size_t dead = t->dead;
+  profiler_start(prof, &s);
+  rbtree_compact(t, 0);
+  profiler_stop(prof, &s);
+  if (dead > 0) {
+    print_sample("compact", dead, &s, shown);
+  }
+
+  delete_rbtree(t);
+  free(arr);
+  free(keys);
+  return found == n && zipf_found == 2 * n ? 0 : 1;
+}
+
+// Bytes currently allocated through malloc, including allocator overhead
+static size_t heap_in_use(void) {
+  const struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+}
+
+static void print_huge(const char *phase, const size_t ops,
+                       const double seconds, const double bytes_per_node) {
+  printf("%-12s %12zu %10.1f %10.2f", phase, ops, seconds * 1e9 / ops,
+         seconds);
+  if (bytes_per_node > 0) {
+    printf(" %12.1f", bytes_per_node);
+  }
+  printf("\n");
+}
+
+// Huge-tree stress (-H): builds an n-key tree from a sorted array and then
+// again one insert at a time, reporting construction time and malloc bytes per
+// node. Meant for n in the billions with driver-key64.
+static int run_huge(const size_t n, const int threads) {
+  printf("n=%zu threads=%d key_bits=%zu sizeof(node_t)=%zu\n", n, threads,
+         sizeof(rbtree_key_t) * 8, sizeof(node_t));
+  printf("%-12s %12s %10s %10s %12s\n", "phase", "ops", "ns/op", "seconds",
+         "bytes/node");
+
+  // sorted keys; a tree larger than the key space repeats each key 2^shift
+  // times
+  int shift = 0;
+  while (((n - 1) >> shift) > (size_t)RBTREE_KEY_MAX) {
+    shift++;
+  }
+  rbtree_key_t *arr = malloc(n * sizeof(rbtree_key_t));
+  if (arr == NULL) {
+    fprintf(stderr, "out of memory for %zu keys\n", n);
+    return 1;
+  }
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = (rbtree_key_t)(i >> shift);
+  }
+
+  size_t before = heap_in_use();
+  double start = now_seconds();
+  rbtree *t = rbtree_from_sorted_array(arr, n, threads);
+  if (t == NULL) {
+    fprintf(stderr, "out of memory building %zu nodes\n", n);
+    free(arr);
+    return 1;
+  }
+  print_huge("build/p", n, now_seconds() - start,
+             (double)(heap_in_use() - before) / n);
+
+  memset(arr, 0, n * sizeof(rbtree_key_t));
+  start = now_seconds();
+  const size_t written = rbtree_to_array_parallel(t, arr, n, threads);
+  print_huge("to_array/p", n, now_seconds() - start, 0);
+  int ok = written == n && rbtree_size(t) == n;
+  for (size_t i = 0; ok && i < n; i++) {
+    ok = arr[i] == (rbtree_key_t)(i >> shift);
+  }
+  free(arr);
+
+  start = now_seconds();
+  delete_rbtree(t);
+  print_huge("delete", n, now_seconds() - start, 0);
+
+  // one allocation and rebalance per key, in scrambled order
+  t = new_rbtree();
+  before = heap_in_use();
+  start = now_seconds();
+  for (size_t i = 0; t != NULL && i < n; i++) {
+    // splitmix64 finalizer, so neither key width sees a structured sequence
+    uint64_t x = (i + 1) * 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    if (rbtree_insert(t, (rbtree_key_t)x) == NULL) {
+      fprintf(stderr, "out of memory after %zu inserts\n", i);
+      delete_rbtree(t);
+      return 1;
+    }
+  }
+  if (t == NULL) {
+    return 1;
+  }
+  print_huge("insert", n, now_seconds() - start,
+             (double)(heap_in_use() - before) / n);
+  ok = ok && rbtree_size(t) == n;
+
+  start = now_seconds();
+  delete_rbtree(t);
+  print_huge("delete", n, now_seconds() - start, 0);
+
+  if (!ok) {
+    fprintf(stderr, "huge tree lost or reordered keys\n");
+  }
+  return ok ? 0 : 1;
+}
+
+static int comp_u64(const void *p1, const void *p2) {
+  const uint64_t a = *(const uint64_t *)p1, b = *(const uint64_t *)p2;
+  return a < b ? -1 : a > b;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Per-operation latency samples collected during replay
+typedef struct {
+  uint64_t *ns;
+  size_t count, cap;
+} latency_t;
+
+static int latency_add(latency_t *l, const uint64_t ns) {
+  if (l->count == l->cap) {
+    const size_t cap = l->cap == 0 ? 1024 : l->cap * 2;
+    uint64_t *p = realloc(l->ns, cap * sizeof(uint64_t));
+    if (p == NULL) {
+      return -1;
+    }
+    l->ns = p;
+    l->cap = cap;
+  }
+  l->ns[l->count++] = ns;
+  return 0;
+}
+
+static const char *trace_op_names[TRACE_OP_COUNT] = {
+    "new",      "delete",   "insert",   "find",        "erase",
+    "min",      "max",      "to_array", "new_bounded", "new_lazy",
+    "clone",    "build",    "key",      "insert_ivl",  "cache",
+    "compact"};
+
+// Replays a trace captured by an RBTREE_TRACE build. scale == 0 runs at full
+// speed; otherwise each record waits until its timestamp * scale. Only the
+// operation itself is timed: reading bulk-build keys and resolving erase
+// targets happen in rbtree_trace_replay_next.
+static int replay_trace(const char *path, const double scale) {
+  trace_replay_t r;
+  if (rbtree_trace_replay_open(&r, path) != 0) {
+    fprintf(stderr, "%s: not a readable rbtree trace\n", path);
+    return 1;
+  }
+
+  latency_t lat[TRACE_OP_COUNT];
+  memset(lat, 0, sizeof(lat));
+  size_t ops = 0;
+  int ret = 0;
+
+  trace_rec_t rec;
+  int got;
+  const uint64_t start = now_ns();
+  while (ret == 0 && (got = rbtree_trace_replay_next(&r, &rec)) > 0) {
+    if (scale > 0) {
+      const uint64_t due = start + (uint64_t)(rec.ns * scale);
+      uint64_t cur = now_ns();
+      if (cur < due) {
+        const struct timespec ts = {(due - cur) / 1000000000ull,
+                                    (due - cur) % 1000000000ull};
+        nanosleep(&ts, NULL);
+      }
+    }
+
+    const uint64_t t0 = now_ns();
+    rbtree_trace_replay_apply(&r, &rec);
+    if (latency_add(&lat[rec.op], now_ns() - t0) != 0) {
+      ret = 1;
+    }
+    ops++;
+  }
+  if (ret == 0 && got < 0) {
+    fprintf(stderr,
+            "%s: cannot replay record %zu (%s on tree %u): corrupt or "
+            "truncated record, unknown tree, or op not in this build\n",
+            path, ops + 1,
+            rec.op < TRACE_OP_COUNT ? trace_op_names[rec.op] : "?", rec.tree);
+    ret = 1;
+  }
+  const double seconds = (now_ns() - start) * 1e-9;
+
+  printf("replay %s: %zu ops in %.3f s (%.0f ops/s)\n", path, ops, seconds,
+         ops / seconds);
+  printf("%-12s %12s %10s %10s %10s %10s\n", "op", "count", "mean-ns",
+         "p50-ns", "p99-ns", "max-ns");
+  for (int op = 0; op < TRACE_OP_COUNT; op++) {
+    latency_t *l = &lat[op];
+    if (l->count == 0) {
+      continue;
+    }
+    qsort(l->ns, l->count, sizeof(uint64_t), comp_u64);
+    double sum = 0;
+    for (size_t i = 0; i < l->count; i++) {
+      sum += l->ns[i];
+    }
+    printf("%-12s %12zu %10.0f %10llu %10llu %10llu\n", trace_op_names[op],
+           l->count, sum / l->count,
+           (unsigned long long)l->ns[l->count / 2],
+           (unsigned long long)l->ns[l->count * 99 / 100],
+           (unsigned long long)l->ns[l->count - 1]);
+    free(l->ns);
+  }
+
+  rbtree_trace_replay_close(&r);
+  return ret;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-n keys] [-d rand|seq] [-s seed] [-t threads] [-c sets] "
+          "[-p]\n"
+          "       %s -r trace [-x scale]\n"
+          "       %s -H [-n keys] [-t threads]\n"
+          "  -t  threads for the parallel to_array/build phases\n"
+          "  -c  lookup cache sets for the zipf+cache phase (default n/64)\n"
+          "  -p  report hardware counters per operation (perf_event_open, summed\n"
+          "      over all threads including the -t workers)\n"
+          "  -r  replay a trace recorded with an RBTREE_TRACE build\n"
+          "  -x  replay time scale (0 = full speed, 1 = recorded pace)\n"
+          "  -H  huge-tree stress: construction time and bytes per node\n",
+          prog, prog, prog);
+}
 
 int main(int argc, char *argv[]) {
+  size_t n = 1000000;
+  const char *dist = "rand";
+  unsigned seed = 17;
+  int profile = 0;
+  int threads = 1;
+  int huge = 0;
+  size_t cache_sets = 0;
+  const char *trace = NULL;
+  double scale = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:s:t:c:pr:x:Hh")) != -1) {
+    switch (opt) {
+      case 'n':
+        n = strtoull(optarg, NULL, 10);
+        break;
+      case 'd':
+        dist = optarg;
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        threads = atoi(optarg);
+        break;
+      case 'c':
+        cache_sets = strtoull(optarg, NULL, 10);
+        break;
+      case 'p':
+        profile = 1;
+        break;
+      case 'r':
+        trace = optarg;
+        break;
+      case 'x':
+        scale = strtod(optarg, NULL);
+        break;
+      case 'H':
+        huge = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (trace != NULL) {
+    return replay_trace(trace, scale);
+  }
+  if (huge) {
+    return n == 0 ? 2 : run_huge(n, threads);
+  }
+  if (n == 0 || (strcmp(dist, "rand") != 0 && strcmp(dist, "seq") != 0)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  profiler_t prof;
+  if (profile) {
+    profiler_open(&prof);
+  } else {
+    for (size_t i = 0; i < N_COUNTERS; i++) {
+      prof.fd[i] = -1;
+    }
+    prof.available = 0;
+  }
 
-}
\ No newline at end of file
+  const int ret = run_workload(n, dist, seed, threads, cache_sets, &prof);
+  profiler_close(&prof);
+  return ret;
+}
@@ -1,20 +1,112 @@
-#include "rbtree.h"
+#include "rbtree_internal.h"
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+// RBTREE_TRACE로 빌드하면 공개 함수 호출을 바이너리 트레이스로 기록 (driver -r로 재생)
+#ifdef RBTREE_TRACE
+#include "rbtree_trace.h"
+#define TRACE(op, t, key, arg) rbtree_trace_record(op, t, key, arg)
+#define TRACE_CLONE(c, t) rbtree_trace_record_clone(c, t)
+#define TRACE_BUILD(t, arr, n, nthreads) rbtree_trace_record_build(t, arr, n, nthreads)
+#else
+#define TRACE(op, t, key, arg)
+#define TRACE_CLONE(c, t)
+#define TRACE_BUILD(t, arr, n, nthreads)
+#endif
+
+// 지연 삭제 모드에서 erase/insert 한 번이 compaction으로 검사하는 최대 노드 수
+#define COMPACT_STEP 16
+#define DEFAULT_MAX_DEAD 0.25
 
 void left_rotate(rbtree *t, node_t *x);
 void right_rotate(rbtree *t, node_t *x);
 void rb_insert_fixup(rbtree *t, node_t *node);
 void transplant(rbtree *t, node_t *from, node_t *to);
-node_t *tree_minimum(rbtree *t, node_t *root);
+node_t *tree_minimum(const rbtree *t, node_t *root);
+node_t *tree_maximum(const rbtree *t, node_t *root);
+node_t *tree_successor(const rbtree *t, node_t *x);
+node_t *tree_predecessor(const rbtree *t, node_t *x);
+int beats_bound(const rbtree *t, const rbtree_key_t key);
 void delete_fixup(rbtree *t, node_t *x);
 void delete_node(rbtree *t, node_t *node);
-void inorder(const rbtree *t, key_t *arr, node_t *node, const size_t n, int *order);
+int in_block(const rbtree *t, const node_t *node);
+void init_nil(node_t *nil);
+rbtree *alloc_rbtree(void);
+void cache_free(rbtree *t);
+size_t to_array(const rbtree *t, rbtree_key_t *arr, const size_t n);
+rbtree *new_block_rbtree(const size_t n);
+node_t *clone_subtree(const rbtree *t, rbtree *c, node_t *node, size_t *order);
+void inorder(const rbtree *t, rbtree_key_t *arr, node_t *node, const size_t n, size_t *order);
+#ifdef RBTREE_INTERVAL
+void update_max_high(rbtree *t, node_t *x);
+void update_max_high_path(rbtree *t, node_t *x);
+void overlap_collect(const rbtree *t, node_t *node, const rbtree_key_t low, const rbtree_key_t high, node_t **out, const size_t n, size_t *count);
+#endif
+void run_workers(const int nthreads, void *(*fn)(void *), void *arg);
+int split_depth(const int nthreads);
+void *pool_worker(void *arg);
+void pool_shutdown(void);
+node_t *acquire_node(rbtree *t, const rbtree_key_t key);
+node_t *insert_node(rbtree *t, node_t *new_node);
+void prepare_link(rbtree *t, node_t *new_node);
+node_t *attach_node(rbtree *t, node_t *new_node, node_t *parent, const int left);
+void release_node(rbtree *t, node_t *p);
+int update_all_dead(node_t *x);
+void update_all_dead_path(rbtree *t, node_t *x);
+node_t *first_live(const rbtree *t, node_t *x, const int forward);
+node_t *skip_dead(const rbtree *t, node_t *p, const int forward);
+size_t compact_work(rbtree *t, size_t budget);
+node_t *find_node(const rbtree *t, const rbtree_key_t key);
+rbtree_cache_set_t *cache_set(const rbtree_cache_t *c, const rbtree_key_t key);
+node_t *cache_lookup(rbtree_cache_t *c, const rbtree_key_t key);
+void cache_fill(rbtree_cache_t *c, node_t *node);
+void cache_invalidate(rbtree_cache_t *c, const node_t *node);
+#ifdef RBTREE_WAVL
+void wavl_recolor(rbtree *t, node_t *x);
+void wavl_recolor_around(rbtree *t, node_t *x);
+void wavl_insert_fixup(rbtree *t, node_t *x);
+void wavl_delete_fixup(rbtree *t, node_t *x, node_t *p);
+#endif
+
+/*
+🔴⚫️ NIL 노드 값을 초기화하는 함수
+*/
+void init_nil(node_t *nil)
+{
+  nil->color = RBTREE_BLACK;
+  nil->dead = 0;
+  nil->all_dead = 1; // 빈 서브트리에는 살아 있는 노드가 없음
+#ifdef RBTREE_WAVL
+  nil->rank = -1; // WAVL에서 nil 노드의 랭크는 -1
+#endif
+  nil->key = 0;
+#ifdef RBTREE_INTERVAL
+  nil->high = 0;
+  nil->max_high = RBTREE_KEY_MIN; // 구간 비교에서 항상 지도록 최소값으로 설정
+#endif
+  nil->parent = NULL;
+  nil->left = NULL;
+  nil->right = NULL;
+}
 
 /*
 🔴⚫️ RB 트리 구조체 생성 함수
 */
 rbtree *new_rbtree(void)
+{
+  rbtree *p = alloc_rbtree();
+  TRACE(TRACE_NEW, p, 0, 0);
+  return p;
+}
+
+/*
+🔴⚫️ 빈 RB 트리 구조체를 할당하는 함수 (생성 함수마다 자기 모드로 트레이스를 남기도록 여기서는 기록하지 않음)
+*/
+rbtree *alloc_rbtree(void)
 {
   // RB Tree 포인터
   rbtree *p = (rbtree *)calloc(1, sizeof(rbtree));
@@ -31,12 +123,7 @@ rbtree *new_rbtree(void)
     return NULL;
   }
 
-  // NIL 노드 값 초기화
-  nil->color = RBTREE_BLACK;
-  nil->key = 0;
-  nil->parent = NULL;
-  nil->left = NULL;
-  nil->right = NULL;
+  init_nil(nil);
 
   // RB Tree 필드 값 초기화
   p->root = nil;
@@ -46,6 +133,40 @@ rbtree *new_rbtree(void)
   return p;
 }
 
+/*
+🔴⚫️ 최대 capacity개의 key만 유지하는 용량 제한 RB 트리 생성 함수
+keep이 RBTREE_KEEP_LARGEST면 가장 큰 key들을, RBTREE_KEEP_SMALLEST면 가장 작은 key들을 유지
+*/
+rbtree *new_bounded_rbtree(const size_t capacity, const keep_t keep)
+{
+  rbtree *p = alloc_rbtree();
+  if (p == NULL)
+  {
+    return NULL;
+  }
+  p->capacity = capacity;
+  p->keep = keep;
+  TRACE(TRACE_NEW_BOUNDED, p, capacity, keep);
+  return p;
+}
+
+/*
+🔴⚫️ erase가 노드를 tombstone으로 표시만 하는 지연 삭제 RB 트리 생성 함수
+tombstone 비율이 max_dead를 넘으면 이후의 erase/insert가 조금씩 compaction을 진행함 (0 이하이면 0.25)
+노드마다 서브트리 전체가 tombstone인지 기록해 두므로 min/next/find는 tombstone이 몇 개든 O(log n)에 건너뜀
+*/
+rbtree *new_lazy_rbtree(const double max_dead)
+{
+  rbtree *p = alloc_rbtree();
+  if (p == NULL)
+  {
+    return NULL;
+  }
+  p->max_dead = max_dead > 0 ? max_dead : DEFAULT_MAX_DEAD;
+  TRACE(TRACE_NEW_LAZY, p, 0, trace_double_bits(p->max_dead));
+  return p;
+}
+
 /*
 🔴⚫️ RB 트리의 모든 노드의 메모리를 해제하는 함수
 */
@@ -57,7 +178,10 @@ void delete_node(rbtree *t, node_t *node)
   }
   delete_node(t, node->left);  // 왼쪽 노드 탐색
   delete_node(t, node->right); // 오른쪽 노드 탐색
-  free(node);                  // 메모리 해제
+  if (!in_block(t, node))
+  {
+    free(node); // 메모리 해제 (복제본 블록 안의 노드는 블록과 함께 해제)
+  }
 }
 
 /*
@@ -65,11 +189,257 @@ void delete_node(rbtree *t, node_t *node)
 */
 void delete_rbtree(rbtree *t)
 {
+  TRACE(TRACE_DELETE, t, 0, 0);
+  cache_free(t);
+
+  // 복제본은 따로 할당된 노드가 없으면 블록 하나만 해제하면 됨 (O(1))
+  if (t->block != NULL)
+  {
+    if (t->heap_nodes > 0)
+    {
+      delete_node(t, t->root);
+    }
+    free(t); // 트리 구조체, nil 노드, 복제된 노드가 모두 같은 블록
+    return;
+  }
+
   delete_node(t, t->root); // 루트 노드를 포함한 모든 노드의 메모리 해제
   free(t->nil);            // nil 노드 메모리 해제
   free(t);                 // RB Tree 메모리 해제
 }
 
+/*
+🔴⚫️ 트리에 들어 있는 key 수를 반환하는 함수 (지연 삭제된 tombstone은 세지 않음)
+*/
+size_t rbtree_size(const rbtree *t)
+{
+  return t->size - t->dead;
+}
+
+/*
+🔴⚫️ 조회 캐시를 켜는 함수 (sets는 2의 거듭제곱으로 올림, 0이면 캐시를 끔). 성공하면 0, 실패하면 -1
+find/insert가 캐시를 채우고 트리에서 빠지는 노드는 그 자리에서 캐시에서도 지움
+캐시를 켠 트리는 rbtree_find(const rbtree *)도 캐시를 고치므로 여러 스레드가 동시에 find하면 안 됨
+(트리 내용은 그대로이고, async_rbtree의 read lock은 이런 트리의 읽기를 하나씩 들여보냄)
+*/
+int rbtree_enable_cache(rbtree *t, const size_t sets)
+{
+  TRACE(TRACE_ENABLE_CACHE, t, sets, 0);
+  cache_free(t);
+  if (sets == 0)
+  {
+    return 0;
+  }
+
+  size_t n = 1;
+  while (n < sets)
+  {
+    if (n > SIZE_MAX / 2 / sizeof(rbtree_cache_set_t))
+    {
+      return -1;
+    }
+    n <<= 1;
+  }
+
+  rbtree_cache_t *c = (rbtree_cache_t *)calloc(1, sizeof(rbtree_cache_t));
+  if (c == NULL)
+  {
+    return -1;
+  }
+  c->sets = (rbtree_cache_set_t *)aligned_alloc(_Alignof(rbtree_cache_set_t), n * sizeof(rbtree_cache_set_t));
+  if (c->sets == NULL)
+  {
+    free(c);
+    return -1;
+  }
+  memset(c->sets, 0, n * sizeof(rbtree_cache_set_t));
+  c->mask = n - 1;
+  t->cache = c;
+  return 0;
+}
+
+/*
+🔴⚫️ 조회 캐시를 해제하는 함수
+*/
+void cache_free(rbtree *t)
+{
+  if (t->cache != NULL)
+  {
+    free(t->cache->sets);
+    free(t->cache);
+    t->cache = NULL;
+  }
+}
+
+/*
+🔴⚫️ key가 들어갈 캐시 집합을 구하는 함수 (곱셈 해시의 상위 비트 사용)
+*/
+rbtree_cache_set_t *cache_set(const rbtree_cache_t *c, const rbtree_key_t key)
+{
+  return &c->sets[(size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 32) & c->mask];
+}
+
+/*
+🔴⚫️ 캐시에서 key의 노드를 찾는 함수 (없으면 NULL)
+적중한 항목은 한 칸 앞으로 옮겨서 자주 찾는 key일수록 앞자리에 남게 함
+*/
+node_t *cache_lookup(rbtree_cache_t *c, const rbtree_key_t key)
+{
+  rbtree_cache_set_t *s = cache_set(c, key);
+  for (int w = 0; w < RBTREE_CACHE_WAYS; w++)
+  {
+    if (s->nodes[w] != NULL && s->keys[w] == key)
+    {
+      node_t *node = s->nodes[w];
+      if (w > 0)
+      {
+        s->keys[w] = s->keys[w - 1];
+        s->nodes[w] = s->nodes[w - 1];
+        s->keys[w - 1] = key;
+        s->nodes[w - 1] = node;
+      }
+      c->hits++;
+      return node;
+    }
+  }
+  c->misses++;
+  return NULL;
+}
+
+/*
+🔴⚫️ 노드를 캐시에 넣는 함수
+같은 key가 있으면 그 자리를, 없으면 빈 자리를, 그것도 없으면 마지막 자리를 덮어씀
+새 항목은 뒤쪽에서 시작하므로 한 번 찾고 마는 key가 자주 찾는 key를 밀어내지 못함
+*/
+void cache_fill(rbtree_cache_t *c, node_t *node)
+{
+  rbtree_cache_set_t *s = cache_set(c, node->key);
+  int w = RBTREE_CACHE_WAYS - 1;
+  for (int i = 0; i < RBTREE_CACHE_WAYS; i++)
+  {
+    if (s->nodes[i] != NULL && s->keys[i] == node->key)
+    {
+      w = i;
+      break;
+    }
+    if (s->nodes[i] == NULL && w == RBTREE_CACHE_WAYS - 1)
+    {
+      w = i;
+    }
+  }
+  s->keys[w] = node->key;
+  s->nodes[w] = node;
+}
+
+/*
+🔴⚫️ 트리에서 빠지는 노드를 가리키는 캐시 항목을 지우는 함수 (노드의 key가 바뀌기 전에 호출)
+*/
+void cache_invalidate(rbtree_cache_t *c, const node_t *node)
+{
+  rbtree_cache_set_t *s = cache_set(c, node->key);
+  for (int w = 0; w < RBTREE_CACHE_WAYS; w++)
+  {
+    if (s->nodes[w] == node)
+    {
+      s->nodes[w] = NULL;
+    }
+  }
+}
+
+/*
+🔴⚫️ 노드가 복제본 블록 안에 있는지 확인하는 함수
+*/
+int in_block(const rbtree *t, const node_t *node)
+{
+  return t->block != NULL && node >= t->block && node < t->block + t->block_len;
+}
+
+/*
+🔴⚫️ 트리 구조체, nil 노드, 노드 n개를 한 번에 할당한 빈 트리를 만드는 함수
+*/
+rbtree *new_block_rbtree(const size_t n)
+{
+  if (n > (SIZE_MAX - sizeof(rbtree)) / sizeof(node_t) - 1)
+  {
+    return NULL;
+  }
+
+  rbtree *c = (rbtree *)malloc(sizeof(rbtree) + (n + 1) * sizeof(node_t));
+  if (c == NULL)
+  {
+    return NULL;
+  }
+
+  memset(c, 0, sizeof(rbtree));
+  c->nil = (node_t *)(c + 1);
+  init_nil(c->nil);
+  c->root = c->nil;
+  c->block = c->nil + 1;
+  c->block_len = n;
+  return c;
+}
+
+/*
+🔴⚫️ 서브트리를 중위 순서대로 블록에 복사하고 복사된 서브트리의 루트를 반환하는 함수
+*/
+node_t *clone_subtree(const rbtree *t, rbtree *c, node_t *node, size_t *order)
+{
+  if (node == t->nil)
+  {
+    return c->nil;
+  }
+
+  node_t *left = clone_subtree(t, c, node->left, order);
+
+  // 색상, key, 구간 정보 등은 그대로 복사하고 포인터만 블록 안으로 바꿈
+  node_t *copy = &c->block[(*order)++];
+  *copy = *node;
+  copy->left = left;
+  if (left != c->nil)
+  {
+    left->parent = copy;
+  }
+  if (node == t->bound)
+  {
+    c->bound = copy;
+  }
+
+  node_t *right = clone_subtree(t, c, node->right, order);
+  copy->right = right;
+  if (right != c->nil)
+  {
+    right->parent = copy;
+  }
+  return copy;
+}
+
+/*
+🔴⚫️ 트리 구조와 색상을 그대로 복사한 복제본을 만드는 함수
+트리 구조체, nil 노드, 모든 노드를 한 번의 할당에 담고 노드는 중위 순서로 배치하므로
+재조정 없이 한 번의 순회로 끝나고, 복제본의 순회는 메모리를 순서대로 읽게 됨
+*/
+rbtree *rbtree_clone(const rbtree *t)
+{
+  rbtree *c = new_block_rbtree(t->size);
+  if (c == NULL)
+  {
+    return NULL;
+  }
+  c->size = t->size;
+  c->capacity = t->capacity;
+  c->keep = t->keep;
+  c->max_dead = t->max_dead;
+  c->dead = t->dead;
+
+  size_t order = 0;
+  c->root = clone_subtree(t, c, t->root, &order);
+  c->root->parent = c->nil;
+  c->nil->parent = NULL;
+
+  TRACE_CLONE(c, t);
+  return c;
+}
+
 /*
 🔴⚫️ 주어진 노드를 기준으로 RB 트리를 왼쪽으로 회전시키는 함수
 */
@@ -100,6 +470,19 @@ void left_rotate(rbtree *t, node_t *x)
 
   y->left = x;
   x->parent = y;
+
+  // 지연 삭제 트리에서만 tombstone 서브트리 표시 갱신 (다른 트리는 모든 노드가 0으로 유지됨)
+  if (t->max_dead > 0)
+  {
+    update_all_dead(x);
+    update_all_dead(y);
+  }
+
+#ifdef RBTREE_INTERVAL
+  // 회전 후 아래로 내려간 x부터 max_high 갱신
+  update_max_high(t, x);
+  update_max_high(t, y);
+#endif
 }
 
 /*
@@ -131,6 +514,17 @@ void right_rotate(rbtree *t, node_t *x)
 
   y->right = x;
   x->parent = y;
+
+  if (t->max_dead > 0)
+  {
+    update_all_dead(x);
+    update_all_dead(y);
+  }
+
+#ifdef RBTREE_INTERVAL
+  update_max_high(t, x);
+  update_max_high(t, y);
+#endif
 }
 
 /*
@@ -210,26 +604,71 @@ void rb_insert_fixup(rbtree *t, node_t *node)
   t->root->color = RBTREE_BLACK;
 }
 
+#ifdef RBTREE_INTERVAL
 /*
-🔴⚫️ RB 트리에 새로운 노드를 삽입하는 함수
+🔴⚫️ 노드 x의 max_high 값을 자식 노드들의 값으로부터 다시 계산하는 함수
+*/
+void update_max_high(rbtree *t, node_t *x)
+{
+  rbtree_key_t max = x->high;
+  if (x->left->max_high > max)
+  {
+    max = x->left->max_high;
+  }
+  if (x->right->max_high > max)
+  {
+    max = x->right->max_high;
+  }
+  x->max_high = max;
+}
+
+/*
+🔴⚫️ 노드 x부터 루트까지 올라가면서 max_high 값을 갱신하는 함수
 */
-node_t *rbtree_insert(rbtree *t, const key_t key)
+void update_max_high_path(rbtree *t, node_t *x)
 {
-  // 새로 추가할 노드 메모리 할당하기
-  struct node_t *new_node = calloc(1, sizeof(struct node_t));
+  while (x != t->nil)
+  {
+    update_max_high(t, x);
+    x = x->parent;
+  }
+}
+#endif
 
-  // 메모리 할당에 실패한 경우 NULL 리턴
+/*
+🔴⚫️ RB 트리에 새로운 노드를 삽입하는 함수
+*/
+node_t *rbtree_insert(rbtree *t, const rbtree_key_t key)
+{
+  TRACE(TRACE_INSERT, t, key, 0);
+  node_t *new_node = acquire_node(t, key);
   if (new_node == NULL)
   {
     return NULL;
   }
-
-  // 새로 추가할 노드 값 초기화
-  new_node->color = RBTREE_RED;
   new_node->key = key;
-  new_node->parent = t->nil;
-  new_node->left = t->nil;
-  new_node->right = t->nil;
+#ifdef RBTREE_INTERVAL
+  new_node->high = key;
+#endif
+  return insert_node(t, new_node);
+}
+
+/*
+🔴⚫️ key(구간 트리면 high도)가 초기화된 노드를 RB 트리에 연결하고 재조정하는 함수
+노드 메모리는 호출하는 쪽이 관리하므로 다른 구조체에 노드를 내장(intrusive)해서 쓸 수 있음
+*/
+node_t *rbtree_link_node(rbtree *t, node_t *new_node)
+{
+  const rbtree_key_t key = new_node->key;
+  prepare_link(t, new_node);
+
+  // 용량 제한 트리라면 경계 노드 갱신
+  // 같은 key는 오른쪽에 연결되므로 최소 노드가 경계인 KEEP_LARGEST에서는 경계와 같은 key가 경계 뒤에,
+  // 최대 노드가 경계인 KEEP_SMALLEST에서는 경계 뒤의 새 최대 노드가 됨
+  if (t->capacity > 0 && (t->bound == NULL || (t->keep == RBTREE_KEEP_LARGEST ? key < t->bound->key : key >= t->bound->key)))
+  {
+    t->bound = new_node;
+  }
 
   // 만약 트리가 비어있는 상태라면 루트 노드를 추가하고 리턴하기
   if (t->root == t->nil)
@@ -256,77 +695,258 @@ node_t *rbtree_insert(rbtree *t, const key_t key)
     }
   }
 
-  // 노드를 추가할 위치를 찾은 경우 새로 추가할 노드의 부모 노드 설정
-  new_node->parent = prev;
-
   // 부모 노드의 왼쪽 자식 또는 오른쪽 자식으로 추가
-  if (new_node->key < prev->key)
+  return attach_node(t, new_node, prev, key < prev->key);
+}
+
+/*
+🔴⚫️ 노드를 pos 바로 다음(중위 순서)에 연결하고 재조정하는 함수
+같은 key가 여러 개일 때 key만으로는 자리를 정할 수 없는 경우에 씀 (pos->key <= key <= 다음 노드의 key여야 함)
+*/
+node_t *rbtree_link_after(rbtree *t, node_t *pos, node_t *new_node)
+{
+  prepare_link(t, new_node);
+
+  // pos 뒤에 붙으므로 최소 노드가 될 수는 없고, pos가 최대 노드일 때만 새 최대 노드가 됨
+  if (t->capacity > 0 && t->keep == RBTREE_KEEP_SMALLEST && t->bound == pos)
   {
-    prev->left = new_node;
+    t->bound = new_node;
   }
-  else
+
+  // 오른쪽 서브트리가 없으면 pos의 오른쪽 자식, 있으면 그 서브트리 최소 노드의 왼쪽 자식
+  if (pos->right == t->nil)
   {
-    prev->right = new_node;
+    return attach_node(t, new_node, pos, 0);
   }
+  return attach_node(t, new_node, tree_minimum(t, pos->right), 1);
+}
 
-  rb_insert_fixup(t, new_node);
-
-  return new_node;
+/*
+🔴⚫️ 연결할 노드의 색상과 포인터를 초기화하고 노드 수를 늘리는 함수
+*/
+void prepare_link(rbtree *t, node_t *new_node)
+{
+  new_node->color = RBTREE_RED;
+  new_node->dead = 0;
+  new_node->all_dead = 0;
+#ifdef RBTREE_WAVL
+  new_node->rank = 0; // 새 leaf 노드의 랭크는 0
+#endif
+#ifdef RBTREE_INTERVAL
+  new_node->max_high = new_node->high;
+#endif
+  new_node->parent = t->nil;
+  new_node->left = t->nil;
+  new_node->right = t->nil;
+  t->size++;
 }
 
 /*
-🔴⚫️ 주어진 key에 해당되는 노드의 포인터를 반환하는 함수
+🔴⚫️ 노드를 parent의 비어 있는 왼쪽(left가 1) 또는 오른쪽 자식으로 붙이고 재조정하는 함수
 */
-node_t *rbtree_find(const rbtree *t, const key_t key)
+node_t *attach_node(rbtree *t, node_t *new_node, node_t *parent, const int left)
 {
-  node_t *curr = t->root;
-  while (curr != t->nil && curr->key != key)
+  new_node->parent = parent;
+  if (left)
   {
-    if (curr->key < key)
-    {
-      curr = curr->right;
-    }
-    else
-    {
-      curr = curr->left;
-    }
+    parent->left = new_node;
+  }
+  else
+  {
+    parent->right = new_node;
   }
 
-  // 주어진 key에 해당되는 노드가 없는 경우
-  if (curr == t->nil)
+#ifdef RBTREE_INTERVAL
+  // 새 노드의 high가 조상들의 max_high에 반영되도록 경로 갱신
+  update_max_high_path(t, parent);
+#endif
+  // 살아 있는 노드가 생겼으므로 모두 tombstone이던 조상들의 표시를 지움
+  for (node_t *a = parent; a != t->nil && a->all_dead; a = a->parent)
   {
-    return NULL;
+    a->all_dead = 0;
   }
 
-  return curr;
+#ifdef RBTREE_WAVL
+  wavl_insert_fixup(t, new_node);
+#else
+  rb_insert_fixup(t, new_node);
+#endif
+
+  return new_node;
 }
 
 /*
-🔴⚫️ RB 트리 내에서 최소값을 가진 노드의 포인터를 반환하는 함수
+🔴⚫️ 용량 제한 트리에서 새 key가 현재 경계값(bound)보다 더 유리한지 확인하는 함수
 */
-node_t *rbtree_min(const rbtree *t)
+int beats_bound(const rbtree *t, const rbtree_key_t key)
 {
-  node_t *curr = t->root;
-  while (curr != t->nil && curr->left != t->nil)
+  if (t->keep == RBTREE_KEEP_LARGEST)
   {
-    curr = curr->left;
+    return key > t->bound->key;
   }
-  return curr;
+  return key < t->bound->key;
 }
 
 /*
-🔴⚫️ RB 트리 내에서 최대값을 가진 노드의 포인터를 반환하는 함수
+🔴⚫️ key를 넣을 노드를 준비하는 함수 (넣을 수 없으면 NULL)
+용량 제한 트리가 가득 찬 경우 경계값보다 나은 key면 경계 노드를 빼내 재사용하고, 아니면 할당 없이 O(1)로 거절
 */
-node_t *rbtree_max(const rbtree *t)
+node_t *acquire_node(rbtree *t, const rbtree_key_t key)
 {
-  node_t *curr = t->root;
-  while (curr != t->nil && curr->right != t->nil)
+  if (t->capacity > 0 && t->size >= t->capacity)
   {
-    curr = curr->right;
+    if (!beats_bound(t, key))
+    {
+      return NULL;
+    }
+
+    // 떼어내면 경계는 다음 순서의 노드로 옮겨짐
+    node_t *node = t->bound;
+    rbtree_unlink_node(t, node);
+    return node;
   }
+
+  // 새로 추가할 노드 메모리 할당하기 (실패하면 NULL)
+  node_t *node = calloc(1, sizeof(struct node_t));
+  if (node != NULL && t->block != NULL)
+  {
+    t->heap_nodes++;
+  }
+  return node;
+}
+
+/*
+🔴⚫️ 값이 채워진 노드를 트리에 넣고 조회 캐시와 compaction을 이어서 처리하는 함수
+*/
+node_t *insert_node(rbtree *t, node_t *new_node)
+{
+  rbtree_link_node(t, new_node);
+
+  if (t->cache != NULL)
+  {
+    cache_fill(t->cache, new_node);
+  }
+
+  // 진행 중인 compaction이 있으면 정해진 만큼만 진행
+  if (t->sweep != NULL)
+  {
+    compact_work(t, COMPACT_STEP);
+  }
+
+  return new_node;
+}
+
+#ifdef RBTREE_INTERVAL
+/*
+🔴⚫️ RB 트리에 [low, high] 구간을 가진 노드를 삽입하는 함수
+노드는 low를 key로 하여 정렬되고, 서브트리의 max_high는 회전과 함께 유지됨
+*/
+node_t *rbtree_insert_interval(rbtree *t, const rbtree_key_t low, const rbtree_key_t high)
+{
+  TRACE(TRACE_INSERT_INTERVAL, t, low, high);
+  node_t *new_node = acquire_node(t, low);
+  if (new_node == NULL)
+  {
+    return NULL;
+  }
+  new_node->key = low;
+  new_node->high = high;
+  return insert_node(t, new_node);
+}
+#endif
+
+/*
+🔴⚫️ 주어진 key에 해당되는 노드의 포인터를 반환하는 함수
+조회 캐시가 켜져 있으면 캐시를 먼저 보고, 트리에서 찾은 노드는 캐시에 넣음
+*/
+node_t *rbtree_find(const rbtree *t, const rbtree_key_t key)
+{
+  TRACE(TRACE_FIND, t, key, 0);
+  if (t->cache == NULL)
+  {
+    return find_node(t, key);
+  }
+
+  node_t *node = cache_lookup(t->cache, key);
+  if (node == NULL)
+  {
+    node = find_node(t, key);
+    if (node != NULL)
+    {
+      cache_fill(t->cache, node);
+    }
+  }
+  return node;
+}
+
+/*
+🔴⚫️ 트리를 내려가며 key에 해당되는 살아 있는 노드를 찾는 함수 (없으면 NULL)
+*/
+node_t *find_node(const rbtree *t, const rbtree_key_t key)
+{
+  node_t *curr = t->root;
+  while (curr != t->nil && curr->key != key)
+  {
+    if (curr->key < key)
+    {
+      curr = curr->right;
+    }
+    else
+    {
+      curr = curr->left;
+    }
+  }
+
+  // 주어진 key에 해당되는 노드가 없는 경우
+  if (curr == t->nil)
+  {
+    return NULL;
+  }
+
+  // tombstone이면 같은 key의 살아 있는 노드를 찾음
+  // 같은 key는 중위 순서에서 연속하므로 앞뒤로 가장 가까운 살아 있는 노드만 보면 됨
+  if (curr->dead)
+  {
+    node_t *p = skip_dead(t, curr, 0);
+    if (p != t->nil && p->key == key)
+    {
+      return p;
+    }
+    p = skip_dead(t, curr, 1);
+    return p != t->nil && p->key == key ? p : NULL;
+  }
+
   return curr;
 }
 
+/*
+🔴⚫️ RB 트리 내에서 최소값을 가진 노드의 포인터를 반환하는 함수
+*/
+node_t *rbtree_min(const rbtree *t)
+{
+  TRACE(TRACE_MIN, t, 0, 0);
+  node_t *curr = t->root;
+  while (curr != t->nil && curr->left != t->nil)
+  {
+    curr = curr->left;
+  }
+  return skip_dead(t, curr, 1);
+}
+
+/*
+🔴⚫️ RB 트리 내에서 최대값을 가진 노드의 포인터를 반환하는 함수
+*/
+node_t *rbtree_max(const rbtree *t)
+{
+  TRACE(TRACE_MAX, t, 0, 0);
+  node_t *curr = t->root;
+  while (curr != t->nil && curr->right != t->nil)
+  {
+    curr = curr->right;
+  }
+  return skip_dead(t, curr, 0);
+}
+
 /*
 🔴⚫️ 노드 u의 위치로 노드 v를 옮기는 함수
 */
@@ -345,7 +965,7 @@ void transplant(rbtree *t, node_t *u, node_t *v)
 /*
 🔴⚫️ 주어진 노드의 오른쪽 서브트리에서 최소값을 가진 노드를 찾는 함수
 */
-node_t *tree_minimum(rbtree *t, node_t *root)
+node_t *tree_minimum(const rbtree *t, node_t *root)
 {
   node_t *curr = root;
   while (curr != t->nil && curr->left != t->nil)
@@ -355,6 +975,138 @@ node_t *tree_minimum(rbtree *t, node_t *root)
   return curr;
 }
 
+/*
+🔴⚫️ 주어진 노드의 왼쪽 서브트리에서 최대값을 가진 노드를 찾는 함수
+*/
+node_t *tree_maximum(const rbtree *t, node_t *root)
+{
+  node_t *curr = root;
+  while (curr != t->nil && curr->right != t->nil)
+  {
+    curr = curr->right;
+  }
+  return curr;
+}
+
+/*
+🔴⚫️ 중위 순회 순서에서 주어진 노드의 다음 노드를 찾는 함수 (없으면 nil)
+*/
+node_t *tree_successor(const rbtree *t, node_t *x)
+{
+  if (x->right != t->nil)
+  {
+    return tree_minimum(t, x->right);
+  }
+  node_t *y = x->parent;
+  while (y != t->nil && x == y->right)
+  {
+    x = y;
+    y = y->parent;
+  }
+  return y;
+}
+
+/*
+🔴⚫️ 중위 순회 순서에서 주어진 노드의 이전 노드를 찾는 함수 (없으면 nil)
+*/
+node_t *tree_predecessor(const rbtree *t, node_t *x)
+{
+  if (x->left != t->nil)
+  {
+    return tree_maximum(t, x->left);
+  }
+  node_t *y = x->parent;
+  while (y != t->nil && x == y->left)
+  {
+    x = y;
+    y = y->parent;
+  }
+  return y;
+}
+
+/*
+🔴⚫️ 노드 x의 all_dead를 자식들로부터 다시 계산하고 값이 바뀌었는지 반환하는 함수
+*/
+int update_all_dead(node_t *x)
+{
+  const unsigned char all = x->dead && x->left->all_dead && x->right->all_dead;
+  const int changed = all != x->all_dead;
+  x->all_dead = all;
+  return changed;
+}
+
+/*
+🔴⚫️ 노드 x부터 루트까지 올라가면서 all_dead 값을 갱신하는 함수
+*/
+void update_all_dead_path(rbtree *t, node_t *x)
+{
+  while (x != t->nil)
+  {
+    update_all_dead(x);
+    x = x->parent;
+  }
+}
+
+/*
+🔴⚫️ 서브트리 x에서 중위 순서로(forward가 0이면 역순으로) 처음인 살아 있는 노드를 찾는 함수 (없으면 nil)
+모두 tombstone인 서브트리로는 내려가지 않으므로 O(log n)
+*/
+node_t *first_live(const rbtree *t, node_t *x, const int forward)
+{
+  while (!x->all_dead)
+  {
+    node_t *near = forward ? x->left : x->right;
+    if (!near->all_dead)
+    {
+      x = near;
+    }
+    else if (!x->dead)
+    {
+      return x;
+    }
+    else
+    {
+      x = forward ? x->right : x->left;
+    }
+  }
+  return t->nil;
+}
+
+/*
+🔴⚫️ p부터 중위 순서로(forward가 0이면 역순으로) 이동하며 처음 만나는 살아 있는 노드를 찾는 함수 (없으면 nil)
+p의 뒤쪽 서브트리를 먼저 보고, 모두 tombstone이면 조상으로 올라가며 조상과 그 반대쪽 서브트리를 봄 (O(log n))
+*/
+node_t *skip_dead(const rbtree *t, node_t *p, const int forward)
+{
+  if (p == t->nil || !p->dead)
+  {
+    return p;
+  }
+
+  node_t *far = forward ? p->right : p->left;
+  if (!far->all_dead)
+  {
+    return first_live(t, far, forward);
+  }
+  for (node_t *y = p->parent; y != t->nil; p = y, y = y->parent)
+  {
+    // 앞쪽 자식에서 올라온 경우에만 y와 y의 뒤쪽 서브트리가 p 다음 순서
+    if (p == (forward ? y->left : y->right))
+    {
+      if (!y->dead)
+      {
+        return y;
+      }
+      far = forward ? y->right : y->left;
+      if (!far->all_dead)
+      {
+        return first_live(t, far, forward);
+      }
+    }
+  }
+  return t->nil;
+}
+
 /*
 🔴⚫️ 노드 삭제 후 RB 트리의 속성을 충족할 수 있도록 재조정하는 함수
 */
@@ -451,89 +1203,1074 @@ void delete_fixup(rbtree *t, node_t *x)
   x->color = RBTREE_BLACK;
 }
 
+#ifdef RBTREE_WAVL
 /*
-🔴⚫️ RB 트리에서 인자로 주어진 노드를 삭제하고 메모리를 반환하는 함수
+🔴⚫️ WAVL 랭크로부터 노드의 색상을 다시 계산하는 함수
+랭크가 짝수인 1-child만 빨간색으로 칠하면 RB 트리의 색상 조건을 그대로 만족함
 */
-int rbtree_erase(rbtree *t, node_t *p)
+void wavl_recolor(rbtree *t, node_t *x)
 {
-  node_t *del = p;                     // 삭제할 노드 y
-  color_t original_color = del->color; // 삭제할 노드의 원래 색상
-  node_t *base;                        // 트리 재조정의 기준점이 될 노드 x
-
-  if (p->left == t->nil)
+  if (x == t->nil)
   {
-    base = p->right;
-    // p를 p의 오른쪽 자식 노드로 대체
-    transplant(t, p, p->right);
+    return;
   }
-  else if (p->right == t->nil)
+  if (x->parent == t->nil)
   {
-    base = p->left;
-    // p를 p의 왼쪽 자식 노드로 대체
-    transplant(t, p, p->left);
+    x->color = RBTREE_BLACK;
+    return;
   }
-  else
+  x->color = (x->rank % 2 == 0 && x->parent->rank == x->rank + 1) ? RBTREE_RED : RBTREE_BLACK;
+}
+
+/*
+🔴⚫️ 랭크나 부모가 바뀐 노드와 그 자식들의 색상을 다시 계산하는 함수
+*/
+void wavl_recolor_around(rbtree *t, node_t *x)
+{
+  wavl_recolor(t, x);
+  wavl_recolor(t, x->left);
+  wavl_recolor(t, x->right);
+}
+
+/*
+🔴⚫️ WAVL 트리에 노드를 삽입한 후 랭크 규칙(랭크 차이 1 또는 2)을 복구하는 함수
+삽입만 한 WAVL 트리는 AVL 트리와 같은 모양이 됨
+*/
+void wavl_insert_fixup(rbtree *t, node_t *x)
+{
+  wavl_recolor(t, x);
+
+  // x가 부모와 랭크가 같은 0-child인 동안 반복
+  while (x != t->root && x->parent->rank == x->rank)
   {
-    del = tree_minimum(t, p->right); // successor 찾기
-    original_color = del->color;
-    base = del->right;
-    // 만약 successor가 p의 오른쪽 자식 노드가 아닌 경우
-    if (del != p->right)
+    node_t *p = x->parent;
+    node_t *sibling = (x == p->left) ? p->right : p->left;
+
+    // Case 1. 부모가 0,1 노드인 경우 부모를 승급하고 위로 올라감
+    if (p->rank - sibling->rank == 1)
     {
-      // successor을 successor의 오른쪽 sub tree로 교체
-      transplant(t, del, del->right);
-      del->right = p->right;
-      del->right->parent = del;
+      p->rank++;
+      wavl_recolor_around(t, p);
+      x = p;
+      continue;
+    }
+
+    // 부모가 0,2 노드인 경우 회전 한 번(또는 두 번)으로 끝남
+    if (x == p->left)
+    {
+      node_t *y = x->right;
+      // Case 2. x의 안쪽 자식이 2-child인 경우 단일 회전
+      if (x->rank - y->rank == 2)
+      {
+        right_rotate(t, p);
+        p->rank--;
+        wavl_recolor_around(t, x);
+        wavl_recolor_around(t, p);
+      }
+      // Case 3. x의 안쪽 자식이 1-child인 경우 이중 회전
+      else
+      {
+        left_rotate(t, x);
+        right_rotate(t, p);
+        y->rank++;
+        x->rank--;
+        p->rank--;
+        wavl_recolor_around(t, y);
+        wavl_recolor_around(t, x);
+        wavl_recolor_around(t, p);
+      }
     }
     else
     {
-      // base(successor의 오른쪽 자식 노드)가 nil 노드인 경우를 위해 parent 값 설정해주기
-      base->parent = del;
+      node_t *y = x->left;
+      if (x->rank - y->rank == 2)
+      {
+        left_rotate(t, p);
+        p->rank--;
+        wavl_recolor_around(t, x);
+        wavl_recolor_around(t, p);
+      }
+      else
+      {
+        right_rotate(t, x);
+        left_rotate(t, p);
+        y->rank++;
+        x->rank--;
+        p->rank--;
+        wavl_recolor_around(t, y);
+        wavl_recolor_around(t, x);
+        wavl_recolor_around(t, p);
+      }
     }
-    transplant(t, p, del);
-    del->left = p->left;
-    del->left->parent = del;
-    del->color = p->color;
-  }
-
-  // 삭제하려는 노드의 메모리 해제하기
-  free(p);
-
-  // 검은색 노드를 삭제한 경우 RB 트리 속성이 깨질 수 있으므로 재조정 작업하기
-  if (original_color == RBTREE_BLACK)
-  {
-    delete_fixup(t, base);
+    break;
   }
-
-  return 0;
 }
 
 /*
-🔴⚫️ RB 트리 내에서 최소값을 가진 노드를 찾는 함수
+🔴⚫️ WAVL 트리에서 노드를 뺀 후 랭크 규칙을 복구하는 함수
+x는 빠진 자리를 대신한 노드(nil일 수 있음), p는 그 부모
+강등은 위로 전파될 수 있지만 회전은 최대 두 번이고 상각 O(1)번의 랭크 변경으로 끝남
 */
-void inorder(const rbtree *t, key_t *arr, node_t *node, const size_t n, int *order)
+void wavl_delete_fixup(rbtree *t, node_t *x, node_t *p)
 {
-  // n개까지만 배열로 변환
-  if (node == t->nil || *order > n)
+  wavl_recolor(t, x);
+  if (p == t->nil)
   {
     return;
   }
 
-  inorder(t, arr, node->left, n, order);
+  // 자식이 모두 사라진 랭크 1 노드(2,2 leaf)는 랭크 0으로 강등
+  if (p->left == t->nil && p->right == t->nil && p->rank == 1)
+  {
+    p->rank = 0;
+    wavl_recolor(t, p);
+    x = p;
+    p = p->parent;
+  }
 
-  arr[*order] = node->key;
-  (*order)++;
+  // x가 부모와 랭크 차이 3인 3-child인 동안 반복
+  while (p != t->nil && p->rank - x->rank == 3)
+  {
+    const int is_left = (x == p->left);
+    node_t *sibling = is_left ? p->right : p->left;
 
-  inorder(t, arr, node->right, n, order);
-}
+    // Case 1. 형제가 2-child인 경우 부모를 강등하고 위로 올라감
+    if (p->rank - sibling->rank == 2)
+    {
+      p->rank--;
+      wavl_recolor_around(t, p);
+      x = p;
+      p = p->parent;
+      continue;
+    }
 
-/*
-🔴⚫️ RB 트리를 key를 기준으로 오름차순으로 정렬된 배열로 변환하는 함수
-array의 크기는 n으로 주어지며 tree의 크기가 n 보다 큰 경우에는 순서대로 n개 까지만 변환
-*/
-int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n)
-{
-  int order = 0;
-  inorder(t, arr, t->root, n, &order);
-  return 0;
+    // Case 2. 형제가 2,2 노드인 경우 부모와 형제를 함께 강등하고 위로 올라감
+    if (sibling->rank - sibling->left->rank == 2 && sibling->rank - sibling->right->rank == 2)
+    {
+      p->rank--;
+      sibling->rank--;
+      wavl_recolor_around(t, p);
+      wavl_recolor_around(t, sibling);
+      x = p;
+      p = p->parent;
+      continue;
+    }
+
+    if (is_left)
+    {
+      node_t *outer = sibling->right;
+      // Case 3. 형제의 바깥쪽 자식이 1-child인 경우 단일 회전
+      if (sibling->rank - outer->rank == 1)
+      {
+        left_rotate(t, p);
+        sibling->rank++;
+        p->rank--;
+        if (p->left == t->nil && p->right == t->nil)
+        {
+          p->rank--; // 2,2 leaf가 되지 않도록 한 번 더 강등
+        }
+        wavl_recolor_around(t, sibling);
+        wavl_recolor_around(t, p);
+      }
+      // Case 4. 형제의 안쪽 자식이 1-child인 경우 이중 회전
+      else
+      {
+        node_t *inner = sibling->left;
+        right_rotate(t, sibling);
+        left_rotate(t, p);
+        inner->rank += 2;
+        sibling->rank--;
+        p->rank -= 2;
+        wavl_recolor_around(t, inner);
+        wavl_recolor_around(t, sibling);
+        wavl_recolor_around(t, p);
+      }
+    }
+    else
+    {
+      node_t *outer = sibling->left;
+      if (sibling->rank - outer->rank == 1)
+      {
+        right_rotate(t, p);
+        sibling->rank++;
+        p->rank--;
+        if (p->left == t->nil && p->right == t->nil)
+        {
+          p->rank--;
+        }
+        wavl_recolor_around(t, sibling);
+        wavl_recolor_around(t, p);
+      }
+      else
+      {
+        node_t *inner = sibling->right;
+        left_rotate(t, sibling);
+        right_rotate(t, p);
+        inner->rank += 2;
+        sibling->rank--;
+        p->rank -= 2;
+        wavl_recolor_around(t, inner);
+        wavl_recolor_around(t, sibling);
+        wavl_recolor_around(t, p);
+      }
+    }
+    break;
+  }
+}
+#endif
+
+/*
+🔴⚫️ RB 트리에서 인자로 주어진 노드를 떼어내고 재조정하는 함수
+메모리는 반환하지 않으므로 노드를 다시 연결하거나 호출하는 쪽에서 해제할 수 있음
+경계 노드, compaction 커서, tombstone 수, 캐시 항목은 여기서 함께 정리함
+*/
+void rbtree_unlink_node(rbtree *t, node_t *p)
+{
+  node_t *del = p;                     // 삭제할 노드 y
+  color_t original_color = del->color; // 삭제할 노드의 원래 색상
+  node_t *base;                        // 트리 재조정의 기준점이 될 노드 x
+  node_t *moved;                       // 구조가 바뀐 가장 아래쪽 노드 (max_high, all_dead 갱신과 WAVL 재조정의 시작점)
+
+  // 경계 노드를 떼어내면 다음 순서의 노드로 경계 이동
+  if (p == t->bound)
+  {
+    node_t *next = t->keep == RBTREE_KEEP_LARGEST ? tree_successor(t, p) : tree_predecessor(t, p);
+    t->bound = next == t->nil ? NULL : next;
+  }
+  // compaction 커서가 가리키는 노드를 떼어내면 커서를 다음 노드로 옮김
+  if (p == t->sweep)
+  {
+    node_t *next = tree_successor(t, p);
+    t->sweep = next == t->nil ? NULL : next;
+  }
+  if (p->dead)
+  {
+    p->dead = 0;
+    t->dead--;
+  }
+  // 두 자식이 있는 p 자리로는 successor 노드 자체가 옮겨지므로 (key 복사 없음)
+  // successor의 캐시 항목은 그대로 유효하고 p의 항목만 지우면 됨
+  if (t->cache != NULL)
+  {
+    cache_invalidate(t->cache, p);
+  }
+
+  if (p->left == t->nil)
+  {
+    base = p->right;
+    moved = p->parent;
+    // p를 p의 오른쪽 자식 노드로 대체
+    transplant(t, p, p->right);
+  }
+  else if (p->right == t->nil)
+  {
+    base = p->left;
+    moved = p->parent;
+    // p를 p의 왼쪽 자식 노드로 대체
+    transplant(t, p, p->left);
+  }
+  else
+  {
+    del = tree_minimum(t, p->right); // successor 찾기
+    original_color = del->color;
+    base = del->right;
+    // 만약 successor가 p의 오른쪽 자식 노드가 아닌 경우
+    if (del != p->right)
+    {
+      moved = del->parent;
+      // successor을 successor의 오른쪽 sub tree로 교체
+      transplant(t, del, del->right);
+      del->right = p->right;
+      del->right->parent = del;
+    }
+    else
+    {
+      moved = del;
+      // base(successor의 오른쪽 자식 노드)가 nil 노드인 경우를 위해 parent 값 설정해주기
+      base->parent = del;
+    }
+    transplant(t, p, del);
+    del->left = p->left;
+    del->left->parent = del;
+    del->color = p->color;
+#ifdef RBTREE_WAVL
+    del->rank = p->rank;
+#endif
+  }
+
+  t->size--;
+
+#ifdef RBTREE_INTERVAL
+  // 구조가 바뀐 지점부터 루트까지 max_high 갱신
+  update_max_high_path(t, moved);
+#endif
+  if (t->max_dead > 0)
+  {
+    update_all_dead_path(t, moved);
+  }
+
+#ifdef RBTREE_WAVL
+  // 실제로 빠진 자리는 moved 아래의 base 위치
+  (void)original_color;
+  wavl_delete_fixup(t, base, moved);
+#else
+  // 검은색 노드를 삭제한 경우 RB 트리 속성이 깨질 수 있으므로 재조정 작업하기
+  if (original_color == RBTREE_BLACK)
+  {
+    delete_fixup(t, base);
+  }
+#endif
+}
+
+/*
+🔴⚫️ 트리에서 떼어낸 노드의 메모리를 반환하는 함수 (복제본 블록 안의 노드는 블록과 함께 해제)
+*/
+void release_node(rbtree *t, node_t *p)
+{
+  if (in_block(t, p))
+  {
+    return;
+  }
+  if (t->block != NULL)
+  {
+    t->heap_nodes--;
+  }
+  free(p);
+}
+
+/*
+🔴⚫️ RB 트리에서 인자로 주어진 노드를 삭제하고 메모리를 반환하는 함수
+지연 삭제 모드에서는 O(1)로 tombstone 표시만 하고 (이미 지워진 노드면 -1), 떼어내기와 재조정은 compaction이 맡음
+*/
+int rbtree_erase(rbtree *t, node_t *p)
+{
+  TRACE(TRACE_ERASE, t, p->key, rbtree_equal_rank(t, p));
+  if (t->max_dead > 0)
+  {
+    if (p->dead)
+    {
+      return -1;
+    }
+    p->dead = 1;
+    t->dead++;
+    // 서브트리 전체가 tombstone이 된 조상까지만 표시를 올림
+    node_t *x = p;
+    while (x != t->nil && update_all_dead(x))
+    {
+      x = x->parent;
+    }
+    if (t->cache != NULL)
+    {
+      cache_invalidate(t->cache, p);
+    }
+    // tombstone 비율이 임계값을 넘으면 가장 작은 노드부터 compaction 시작
+    if (t->sweep == NULL && t->dead > t->max_dead * t->size)
+    {
+      t->sweep = tree_minimum(t, t->root);
+    }
+    if (t->sweep != NULL)
+    {
+      compact_work(t, COMPACT_STEP);
+    }
+    return 0;
+  }
+
+  rbtree_unlink_node(t, p);
+
+  // 삭제하려는 노드의 메모리 해제하기
+  release_node(t, p);
+
+  return 0;
+}
+
+/*
+🔴⚫️ 같은 key의 살아 있는 노드 중 중위 순서로 p보다 앞선 노드 수를 구하는 함수 (p가 tombstone이면 -1)
+트레이스가 erase한 노드를 기록하는 데 쓰며, 같은 key의 수만큼 걸림
+*/
+int64_t rbtree_equal_rank(const rbtree *t, node_t *p)
+{
+  if (p->dead)
+  {
+    return -1;
+  }
+  int64_t rank = 0;
+  for (node_t *q = rbtree_prev(t, p); q != NULL && q->key == p->key; q = rbtree_prev(t, q))
+  {
+    rank++;
+  }
+  return rank;
+}
+
+/*
+🔴⚫️ 주어진 key를 가진 노드 하나를 삭제하는 함수 (없으면 -1)
+*/
+int rbtree_erase_key(rbtree *t, const rbtree_key_t key)
+{
+  node_t *p = rbtree_find(t, key);
+  if (p == NULL)
+  {
+    return -1;
+  }
+  return rbtree_erase(t, p);
+}
+
+/*
+🔴⚫️ compaction 커서부터 최대 budget개의 노드를 검사하며 tombstone을 떼어내는 함수
+다음 노드를 먼저 구해 두므로 떼어낸 노드 자리로 successor가 옮겨져도 커서는 유효함
+*/
+size_t compact_work(rbtree *t, size_t budget)
+{
+  size_t removed = 0;
+  while (t->sweep != NULL && budget > 0)
+  {
+    node_t *p = t->sweep;
+    node_t *next = tree_successor(t, p);
+    t->sweep = next == t->nil ? NULL : next;
+    if (p->dead)
+    {
+      rbtree_unlink_node(t, p);
+      release_node(t, p);
+      removed++;
+    }
+    budget--;
+  }
+  return removed;
+}
+
+/*
+🔴⚫️ compaction을 최대 budget개 노드 검사만큼 진행하고 떼어낸 tombstone 수를 반환하는 함수 (budget이 0이면 끝까지)
+유휴 시간이나 별도 스레드에서 호출하면 요청 경로의 erase/insert가 떠맡는 compaction이 줄어듦
+*/
+size_t rbtree_compact(rbtree *t, const size_t budget)
+{
+  TRACE(TRACE_COMPACT, t, budget, 0);
+  if (t->sweep == NULL && t->dead > 0)
+  {
+    t->sweep = tree_minimum(t, t->root);
+  }
+  return compact_work(t, budget == 0 ? SIZE_MAX : budget);
+}
+
+/*
+🔴⚫️ RB 트리 내에서 최소값을 가진 노드를 찾는 함수
+*/
+void inorder(const rbtree *t, rbtree_key_t *arr, node_t *node, const size_t n, size_t *order)
+{
+  // n개까지만 배열로 변환
+  if (node == t->nil || *order >= n)
+  {
+    return;
+  }
+
+  inorder(t, arr, node->left, n, order);
+
+  // 왼쪽 서브트리에서 이미 n개를 채웠다면 배열 밖에 쓰지 않음
+  if (*order >= n)
+  {
+    return;
+  }
+  if (!node->dead)
+  {
+    arr[*order] = node->key;
+    (*order)++;
+  }
+
+  inorder(t, arr, node->right, n, order);
+}
+
+/*
+🔴⚫️ RB 트리를 key를 기준으로 오름차순으로 정렬된 배열로 변환하는 함수
+array의 크기는 n으로 주어지며 tree의 크기가 n 보다 큰 경우에는 순서대로 n개 까지만 변환
+*/
+size_t rbtree_to_array(const rbtree *t, rbtree_key_t *arr, const size_t n)
+{
+  TRACE(TRACE_TO_ARRAY, t, n, 1);
+  return to_array(t, arr, n);
+}
+
+/*
+🔴⚫️ 트레이스를 남기지 않고 중위 순회로 배열을 채우는 함수
+*/
+size_t to_array(const rbtree *t, rbtree_key_t *arr, const size_t n)
+{
+  size_t order = 0;
+  inorder(t, arr, t->root, n, &order);
+  return order;
+}
+
+#ifdef RBTREE_INTERVAL
+/*
+🔴⚫️ [low, high]와 겹치는 구간 중 시작값이 가장 작은 노드를 반환하는 함수
+왼쪽 서브트리의 max_high가 low 이상이면 겹치는 구간은 왼쪽에 있거나 아예 없음 (CLRS 14.3)
+*/
+node_t *rbtree_overlap_first(const rbtree *t, const rbtree_key_t low, const rbtree_key_t high)
+{
+  // tombstone은 max_high에 남아 있어 가지치기가 틀릴 수 있으므로 살아 있는 첫 노드를 순서대로 찾음
+  if (t->dead > 0)
+  {
+    node_t *first = NULL;
+    return rbtree_overlap_all(t, low, high, &first, 1) > 0 ? first : NULL;
+  }
+
+  node_t *curr = t->root;
+  while (curr != t->nil)
+  {
+    if (curr->left != t->nil && curr->left->max_high >= low)
+    {
+      curr = curr->left;
+    }
+    else
+    {
+      if (curr->key <= high && low <= curr->high)
+      {
+        return curr;
+      }
+      // 현재 노드의 시작값이 high보다 크면 오른쪽 서브트리도 겹칠 수 없음
+      if (curr->key > high)
+      {
+        return NULL;
+      }
+      curr = curr->right;
+    }
+  }
+  return NULL;
+}
+
+/*
+🔴⚫️ [low, high]와 겹치는 노드를 시작값 순서대로 수집하는 함수
+max_high가 low보다 작거나 시작값이 high보다 큰 서브트리는 방문하지 않음
+*/
+void overlap_collect(const rbtree *t, node_t *node, const rbtree_key_t low, const rbtree_key_t high, node_t **out, const size_t n, size_t *count)
+{
+  if (node == t->nil || node->max_high < low || *count >= n)
+  {
+    return;
+  }
+
+  overlap_collect(t, node->left, low, high, out, n, count);
+
+  if (node->key > high || *count >= n)
+  {
+    return;
+  }
+  if (low <= node->high && !node->dead)
+  {
+    out[*count] = node;
+    (*count)++;
+  }
+
+  overlap_collect(t, node->right, low, high, out, n, count);
+}
+
+/*
+🔴⚫️ [low, high]와 겹치는 노드들을 out 배열에 최대 n개까지 담고 담은 개수를 반환하는 함수
+*/
+size_t rbtree_overlap_all(const rbtree *t, const rbtree_key_t low, const rbtree_key_t high, node_t **out, const size_t n)
+{
+  size_t count = 0;
+  overlap_collect(t, t->root, low, high, out, n, &count);
+  return count;
+}
+#endif
+
+/*
+🔴⚫️ 중위 순회 순서에서 주어진 노드의 다음 노드를 반환하는 함수 (없으면 NULL)
+*/
+node_t *rbtree_next(const rbtree *t, node_t *p)
+{
+  node_t *next = skip_dead(t, tree_successor(t, p), 1);
+  return next == t->nil ? NULL : next;
+}
+
+/*
+🔴⚫️ 중위 순회 순서에서 주어진 노드의 이전 노드를 반환하는 함수 (없으면 NULL)
+*/
+node_t *rbtree_prev(const rbtree *t, node_t *p)
+{
+  node_t *prev = skip_dead(t, tree_predecessor(t, p), 0);
+  return prev == t->nil ? NULL : prev;
+}
+
+// 병렬 변환/생성이 호출할 때마다 스레드를 만들고 기다리지 않도록 한 번 만든 작업자를 계속 씀
+#define POOL_MAX 256
+
+typedef struct
+{
+  pthread_mutex_t run;  // 한 번에 한 작업만 받음 (바쁘면 호출한 스레드 혼자 처리)
+  pthread_mutex_t lock; // 아래 필드 보호
+  pthread_cond_t work;  // 참여할 자리가 생김
+  pthread_cond_t done;  // 참여한 작업자가 모두 끝남
+  pthread_t threads[POOL_MAX - 1];
+  int nthreads;         // 만든 작업자 수
+  int slots;            // 이번 작업에 더 참여할 수 있는 작업자 수
+  int running;          // fn을 실행 중인 작업자 수
+  int stop;
+  void *(*fn)(void *);
+  void *arg;
+} worker_pool_t;
+
+static worker_pool_t pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                             PTHREAD_COND_INITIALIZER};
+
+/*
+🔴⚫️ 작업자 스레드: 자리가 생길 때마다 fn을 한 번 실행함
+*/
+void *pool_worker(void *arg)
+{
+  (void)arg;
+  pthread_mutex_lock(&pool.lock);
+  for (;;)
+  {
+    while (!pool.stop && pool.slots == 0)
+    {
+      pthread_cond_wait(&pool.work, &pool.lock);
+    }
+    if (pool.stop)
+    {
+      pthread_mutex_unlock(&pool.lock);
+      return NULL;
+    }
+    pool.slots--;
+    pool.running++;
+    void *(*fn)(void *) = pool.fn;
+    void *fn_arg = pool.arg;
+    pthread_mutex_unlock(&pool.lock);
+
+    fn(fn_arg);
+
+    pthread_mutex_lock(&pool.lock);
+    if (--pool.running == 0)
+    {
+      pthread_cond_signal(&pool.done);
+    }
+  }
+}
+
+/*
+🔴⚫️ 프로그램이 끝날 때 작업자 스레드를 정리하는 함수
+*/
+void pool_shutdown(void)
+{
+  pthread_mutex_lock(&pool.lock);
+  pool.stop = 1;
+  pthread_cond_broadcast(&pool.work);
+  pthread_mutex_unlock(&pool.lock);
+  for (int i = 0; i < pool.nthreads; i++)
+  {
+    pthread_join(pool.threads[i], NULL);
+  }
+  pool.nthreads = 0;
+}
+
+/*
+🔴⚫️ fn을 호출한 스레드를 포함해 최대 nthreads개의 스레드에서 동시에 실행하는 함수
+작업자는 처음 필요할 때 만들어 두고 다음 호출에서 다시 씀 (작업은 fn 안에서 나눠 가짐)
+호출한 스레드가 먼저 끝내면 아직 깨어나지 않은 작업자의 자리는 거둬들이므로 깨어나기를 기다리지 않음
+작업자를 만들지 못했거나 다른 스레드가 pool을 쓰고 있으면 호출한 스레드 혼자 처리함
+*/
+void run_workers(const int nthreads, void *(*fn)(void *), void *arg)
+{
+  const int want = (nthreads > POOL_MAX ? POOL_MAX : nthreads) - 1;
+  if (want <= 0 || pthread_mutex_trylock(&pool.run) != 0)
+  {
+    fn(arg);
+    return;
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  if (pool.nthreads == 0)
+  {
+    atexit(pool_shutdown);
+  }
+  while (pool.nthreads < want && pthread_create(&pool.threads[pool.nthreads], NULL, pool_worker, NULL) == 0)
+  {
+    pool.nthreads++;
+  }
+  pool.fn = fn;
+  pool.arg = arg;
+  pool.slots = want < pool.nthreads ? want : pool.nthreads;
+  pthread_cond_broadcast(&pool.work);
+  pthread_mutex_unlock(&pool.lock);
+
+  fn(arg);
+
+  pthread_mutex_lock(&pool.lock);
+  pool.slots = 0;
+  while (pool.running > 0)
+  {
+    pthread_cond_wait(&pool.done, &pool.lock);
+  }
+  pthread_mutex_unlock(&pool.lock);
+  pthread_mutex_unlock(&pool.run);
+}
+
+/*
+🔴⚫️ 스레드 수에 맞춰 작업을 나눌 깊이를 정하는 함수 (스레드당 8개 정도의 서브트리)
+*/
+int split_depth(const int nthreads)
+{
+  int depth = 0;
+  while ((1 << depth) < 8 * nthreads && depth < 20)
+  {
+    depth++;
+  }
+  return depth;
+}
+
+// 병렬 변환에서 출력 순서대로 나열한 구간: 분할 깊이의 서브트리 또는 그 위쪽 노드 하나
+typedef struct
+{
+  node_t *node;
+  int single;
+  int worker;    // 서브트리 key를 모은 작업자
+  size_t start;  // 그 작업자 버퍼에서 구간이 시작하는 위치
+  size_t count;  // 살아 있는 key 수
+  size_t offset; // 출력 배열에서 구간이 시작하는 위치
+} export_seg_t;
+
+// 작업자마다 자기가 맡은 서브트리들의 key를 이어 붙이는 버퍼
+typedef struct
+{
+  rbtree_key_t *keys;
+  size_t len;
+  size_t cap;
+  int failed;
+} export_buf_t;
+
+typedef struct
+{
+  const rbtree *t;
+  rbtree_key_t *arr;
+  size_t n;
+  export_seg_t *segs;
+  size_t nsegs;
+  export_buf_t *bufs;
+  int nbufs;
+  atomic_int workers; // 모으기 단계에서 작업자 번호를 나눠 줌
+  atomic_size_t next;
+  int copying;        // 0이면 모으기 단계, 1이면 복사 단계
+} export_job_t;
+
+/*
+🔴⚫️ 분할 깊이까지 내려가며 출력 순서대로 구간을 나열하는 함수
+*/
+void export_collect(const rbtree *t, node_t *node, const int depth, const int split, export_seg_t *segs, size_t *k)
+{
+  if (node == t->nil)
+  {
+    return;
+  }
+  if (depth == split)
+  {
+    segs[*k].node = node;
+    segs[*k].single = 0;
+    (*k)++;
+    return;
+  }
+  export_collect(t, node->left, depth + 1, split, segs, k);
+  segs[*k].node = node;
+  segs[*k].single = 1;
+  segs[*k].count = !node->dead;
+  (*k)++;
+  export_collect(t, node->right, depth + 1, split, segs, k);
+}
+
+/*
+🔴⚫️ 서브트리의 살아 있는 key를 중위 순서로 버퍼 뒤에 붙이는 함수 (메모리가 부족하면 failed 표시)
+*/
+void export_append(const rbtree *t, node_t *node, export_buf_t *buf)
+{
+  if (node == t->nil || buf->failed)
+  {
+    return;
+  }
+  export_append(t, node->left, buf);
+  if (!node->dead)
+  {
+    if (buf->len == buf->cap)
+    {
+      const size_t cap = buf->cap * 2 + 64;
+      rbtree_key_t *keys = (rbtree_key_t *)realloc(buf->keys, cap * sizeof(rbtree_key_t));
+      if (keys == NULL)
+      {
+        buf->failed = 1;
+        return;
+      }
+      buf->keys = keys;
+      buf->cap = cap;
+    }
+    buf->keys[buf->len++] = node->key;
+  }
+  export_append(t, node->right, buf);
+}
+
+/*
+🔴⚫️ 병렬 변환 작업자: 구간을 하나씩 가져가 자기 버퍼에 모으거나, 모은 key를 출력 배열의 제자리로 복사함
+*/
+void *export_worker(void *arg)
+{
+  export_job_t *job = (export_job_t *)arg;
+  export_buf_t *buf = NULL;
+  int worker = -1;
+  if (!job->copying)
+  {
+    worker = atomic_fetch_add(&job->workers, 1);
+    if (worker >= job->nbufs)
+    {
+      return NULL;
+    }
+    buf = &job->bufs[worker];
+  }
+
+  for (;;)
+  {
+    const size_t i = atomic_fetch_add(&job->next, 1);
+    if (i >= job->nsegs)
+    {
+      return NULL;
+    }
+    export_seg_t *seg = &job->segs[i];
+    if (!job->copying)
+    {
+      if (!seg->single)
+      {
+        seg->worker = worker;
+        seg->start = buf->len;
+        export_append(job->t, seg->node, buf);
+        seg->count = buf->len - seg->start;
+      }
+    }
+    else if (seg->offset < job->n && seg->count > 0)
+    {
+      if (seg->single)
+      {
+        job->arr[seg->offset] = seg->node->key;
+      }
+      else
+      {
+        const size_t room = job->n - seg->offset;
+        const size_t len = seg->count < room ? seg->count : room;
+        memcpy(job->arr + seg->offset, job->bufs[seg->worker].keys + seg->start, len * sizeof(rbtree_key_t));
+      }
+    }
+  }
+}
+
+/*
+🔴⚫️ rbtree_to_array를 nthreads개의 스레드로 나눠 수행하는 함수
+위쪽 몇 단계만 순서대로 나누고, 분할 깊이의 서브트리들을 작업자가 나눠 가져가 각자의 버퍼에 한 번의 순회로 모은 뒤
+구간별 크기로 출력 위치를 구해 겹치지 않는 배열 조각으로 병렬 복사함
+(서브트리 크기를 노드에 두지 않으므로 위치를 먼저 구하려면 트리를 한 번 더 순회해야 하는데, 복사가 그보다 쌈)
+*/
+size_t rbtree_to_array_parallel(const rbtree *t, rbtree_key_t *arr, const size_t n, const int nthreads)
+{
+  TRACE(TRACE_TO_ARRAY, t, n, nthreads);
+  if (nthreads <= 1)
+  {
+    return to_array(t, arr, n);
+  }
+
+  const int split = split_depth(nthreads);
+  export_job_t job;
+  job.nbufs = nthreads > POOL_MAX ? POOL_MAX : nthreads;
+  job.segs = (export_seg_t *)malloc(((size_t)2 << split) * sizeof(export_seg_t));
+  job.bufs = (export_buf_t *)calloc(job.nbufs, sizeof(export_buf_t));
+  if (job.segs == NULL || job.bufs == NULL)
+  {
+    free(job.segs);
+    free(job.bufs);
+    return to_array(t, arr, n);
+  }
+  job.t = t;
+  job.arr = arr;
+  job.n = n;
+  job.nsegs = 0;
+  export_collect(t, t->root, 0, split, job.segs, &job.nsegs);
+
+  // 1단계: 서브트리별로 key 모으기
+  job.copying = 0;
+  atomic_init(&job.workers, 0);
+  atomic_init(&job.next, 0);
+  run_workers(nthreads, export_worker, &job);
+
+  // 구간별 시작 위치 (prefix sum)
+  size_t offset = 0;
+  int failed = 0;
+  for (size_t i = 0; i < job.nsegs; i++)
+  {
+    job.segs[i].offset = offset;
+    offset += job.segs[i].count;
+  }
+  for (int i = 0; i < job.nbufs; i++)
+  {
+    failed |= job.bufs[i].failed;
+  }
+
+  // 2단계: 겹치지 않는 조각으로 복사 (버퍼를 못 늘린 작업자가 있으면 순서대로 다시 변환)
+  if (failed)
+  {
+    offset = to_array(t, arr, n);
+  }
+  else
+  {
+    job.copying = 1;
+    atomic_store(&job.next, 0);
+    run_workers(nthreads, export_worker, &job);
+  }
+
+  for (int i = 0; i < job.nbufs; i++)
+  {
+    free(job.bufs[i].keys);
+  }
+  free(job.bufs);
+  free(job.segs);
+  return offset < n ? offset : n;
+}
+
+// 병렬 생성에서 분할 깊이의 서브트리 하나가 맡을 배열 범위
+typedef struct
+{
+  size_t lo, hi;
+  int depth;
+} build_task_t;
+
+typedef struct
+{
+  rbtree *t;
+  const rbtree_key_t *arr;
+  int red_depth; // 이 깊이의 노드는 빨간색 (마지막 레벨이 덜 찬 경우)
+  build_task_t *tasks;
+  size_t ntasks;
+  atomic_size_t next;
+} build_job_t;
+
+/*
+🔴⚫️ 정렬된 arr[lo, hi)로 균형 잡힌 서브트리를 만드는 함수
+노드 arr[i]는 항상 block[i]이므로 분할 깊이(split)에서는 이미 만든 서브트리의 루트를 그대로 연결함
+*/
+node_t *build_range(build_job_t *job, const size_t lo, const size_t hi, const int depth, node_t *parent, const int split)
+{
+  rbtree *t = job->t;
+  if (lo >= hi)
+  {
+    return t->nil;
+  }
+
+  node_t *node = &t->block[lo + (hi - lo) / 2];
+  node->parent = parent;
+  if (depth == split)
+  {
+    return node;
+  }
+
+  node->key = job->arr[lo + (hi - lo) / 2];
+  node->dead = 0;
+  node->all_dead = 0;
+  node->left = build_range(job, lo, lo + (hi - lo) / 2, depth + 1, node, split);
+  node->right = build_range(job, lo + (hi - lo) / 2 + 1, hi, depth + 1, node, split);
+#ifdef RBTREE_INTERVAL
+  node->high = node->key;
+  update_max_high(t, node);
+#endif
+#ifdef RBTREE_WAVL
+  // 높이를 랭크로 쓰면 형제 서브트리 크기 차이가 1 이하라서 랭크 차이는 1 또는 2
+  node->rank = 1 + (node->left->rank > node->right->rank ? node->left->rank : node->right->rank);
+  wavl_recolor(t, node->left);
+  wavl_recolor(t, node->right);
+#else
+  // 모든 nil은 red_depth 또는 그 아래 한 단계에 있으므로 그 위는 검은색, red_depth는 빨간색
+  node->color = depth >= job->red_depth ? RBTREE_RED : RBTREE_BLACK;
+#endif
+  return node;
+}
+
+/*
+🔴⚫️ 분할 깊이에 있는 서브트리들의 배열 범위를 나열하는 함수
+*/
+void build_collect(build_job_t *job, const size_t lo, const size_t hi, const int depth, const int split)
+{
+  if (lo >= hi)
+  {
+    return;
+  }
+  if (depth == split)
+  {
+    job->tasks[job->ntasks].lo = lo;
+    job->tasks[job->ntasks].hi = hi;
+    job->tasks[job->ntasks].depth = depth;
+    job->ntasks++;
+    return;
+  }
+  build_collect(job, lo, lo + (hi - lo) / 2, depth + 1, split);
+  build_collect(job, lo + (hi - lo) / 2 + 1, hi, depth + 1, split);
+}
+
+/*
+🔴⚫️ 병렬 생성 작업자: 분할 깊이의 서브트리를 하나씩 가져가 만듦
+*/
+void *build_worker(void *arg)
+{
+  build_job_t *job = (build_job_t *)arg;
+  for (;;)
+  {
+    const size_t i = atomic_fetch_add(&job->next, 1);
+    if (i >= job->ntasks)
+    {
+      return NULL;
+    }
+    build_task_t *task = &job->tasks[i];
+    build_range(job, task->lo, task->hi, task->depth, NULL, -1);
+  }
+}
+
+/*
+🔴⚫️ 오름차순으로 정렬된 배열로 균형 잡힌 RB 트리를 만드는 함수
+회전 없이 가운데 원소를 루트로 잡아 만들고, 노드는 복제본처럼 한 블록에 중위 순서로 배치
+nthreads가 2 이상이면 분할 깊이 아래의 서브트리들을 여러 스레드가 나눠 만듦
+*/
+rbtree *rbtree_from_sorted_array(const rbtree_key_t *arr, const size_t n, const int nthreads)
+{
+  rbtree *t = new_block_rbtree(n);
+  if (t == NULL)
+  {
+    return NULL;
+  }
+  t->size = n;
+
+  build_job_t job;
+  job.t = t;
+  job.arr = arr;
+  job.red_depth = 0;
+  while (job.red_depth < 64 && (n + 1) >> (job.red_depth + 1) > 0)
+  {
+    job.red_depth++; // floor(log2(n + 1)): 가득 찬 레벨의 수
+  }
+  job.tasks = NULL;
+  job.ntasks = 0;
+
+  int split = -1;
+  if (nthreads > 1)
+  {
+    split = split_depth(nthreads);
+    job.tasks = (build_task_t *)malloc(((size_t)1 << split) * sizeof(build_task_t));
+    if (job.tasks == NULL)
+    {
+      split = -1;
+    }
+  }
+
+  if (split >= 0)
+  {
+    build_collect(&job, 0, n, 0, split);
+    atomic_init(&job.next, 0);
+    run_workers(nthreads, build_worker, &job);
+  }
+  // 분할 깊이 위쪽 노드를 만들고 병렬로 만든 서브트리들을 연결 (split이 -1이면 전체를 만듦)
+  t->root = build_range(&job, 0, n, 0, t->nil, split);
+  t->root->color = RBTREE_BLACK;
+  t->nil->parent = NULL;
+
+  free(job.tasks);
+  TRACE_BUILD(t, arr, n, nthreads);
+  return t;
 }
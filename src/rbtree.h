@@ -1,32 +1,104 @@
 #ifndef _RBTREE_H_
 #define _RBTREE_H_
 
+#include <limits.h>
 #include <stddef.h>
 
 typedef enum { RBTREE_RED, RBTREE_BLACK } color_t;
 
-typedef int key_t;
+#ifdef RBTREE_KEY64
+#include <stdint.h>
+typedef int64_t rbtree_key_t;
+#define RBTREE_KEY_MIN INT64_MIN
+#define RBTREE_KEY_MAX INT64_MAX
+#else
+typedef int rbtree_key_t;
+#define RBTREE_KEY_MIN INT_MIN
+#define RBTREE_KEY_MAX INT_MAX
+// 예전 이름 (64비트 key 빌드에서는 POSIX의 key_t(ftok, shmget)를 가리지 않도록 정의하지 않음)
+typedef rbtree_key_t key_t;
+#endif
 
 typedef struct node_t {
-  color_t color;
-  key_t key;
+  unsigned char color;  // color_t (tombstone 표시와 함께 4바이트 안에 들어가도록 1바이트로 저장)
+  unsigned char dead;   // 지연 삭제 모드에서 erase된 노드 (tombstone)
+  unsigned char all_dead;  // 이 노드가 루트인 서브트리가 모두 tombstone (nil은 1, 조회가 tombstone 무리를 한 번에 건너뜀)
+#ifdef RBTREE_WAVL
+  int rank;  // WAVL 랭크, color는 랭크로부터 계산해 둔 값
+#endif
+  rbtree_key_t key;  // 구간 트리로 쓸 때는 구간의 시작값(low)
+#ifdef RBTREE_INTERVAL
+  rbtree_key_t high;      // 구간의 끝값, 일반 노드는 key와 같음
+  rbtree_key_t max_high;  // 서브트리 내 high의 최대값
+#endif
   struct node_t *parent, *left, *right;
 } node_t;
 
+typedef enum { RBTREE_KEEP_LARGEST, RBTREE_KEEP_SMALLEST } keep_t;
+
+// 조회 캐시: key → 노드 포인터를 담는 집합 연관(set-associative) 테이블, 집합 하나가 캐시 라인 하나
+#define RBTREE_CACHE_WAYS 4
+
+typedef struct {
+  _Alignas(64) rbtree_key_t keys[RBTREE_CACHE_WAYS];
+  node_t *nodes[RBTREE_CACHE_WAYS];  // NULL이면 빈 자리
+} rbtree_cache_set_t;
+
+typedef struct {
+  rbtree_cache_set_t *sets;
+  size_t mask;  // 집합 수 - 1 (집합 수는 2의 거듭제곱)
+  size_t hits, misses;
+} rbtree_cache_t;
+
 typedef struct {
   node_t *root;
   node_t *nil;  // for sentinel
+  size_t size;  // tombstone을 포함한 노드 수 (살아 있는 key 수는 rbtree_size)
+  // 용량 제한 모드: capacity가 0이면 제한 없음
+  size_t capacity;
+  keep_t keep;
+  node_t *bound;  // 가득 찼을 때 가장 먼저 밀려날 노드 (KEEP_LARGEST면 최소 노드)
+  // 복제본: 노드들이 트리 구조체와 같은 할당의 연속 배열에 들어 있음
+  node_t *block;
+  size_t block_len;
+  size_t heap_nodes;  // 복제 후 따로 할당되어 아직 트리에 있는 노드 수
+  // 지연 삭제 모드: max_dead가 0이면 꺼져 있음, size는 tombstone을 포함한 노드 수
+  double max_dead;  // tombstone 비율이 이 값을 넘으면 compaction 시작
+  size_t dead;      // tombstone 수
+  node_t *sweep;    // 진행 중인 compaction이 다음에 검사할 노드 (없으면 NULL)
+  rbtree_cache_t *cache;  // rbtree_enable_cache로 켠 조회 캐시 (없으면 NULL, const 트리의 find도 고침)
 } rbtree;
 
 rbtree *new_rbtree(void);
+rbtree *new_bounded_rbtree(const size_t, const keep_t);
+rbtree *new_lazy_rbtree(const double);
+rbtree *rbtree_clone(const rbtree *);
+rbtree *rbtree_from_sorted_array(const rbtree_key_t *, const size_t, const int);
 void delete_rbtree(rbtree *);
 
-node_t *rbtree_insert(rbtree *, const key_t);
-node_t *rbtree_find(const rbtree *, const key_t);
+size_t rbtree_size(const rbtree *);
+int rbtree_enable_cache(rbtree *, const size_t);
+
+node_t *rbtree_insert(rbtree *, const rbtree_key_t);
+node_t *rbtree_find(const rbtree *, const rbtree_key_t);
 node_t *rbtree_min(const rbtree *);
 node_t *rbtree_max(const rbtree *);
 int rbtree_erase(rbtree *, node_t *);
+int rbtree_erase_key(rbtree *, const rbtree_key_t);
+size_t rbtree_compact(rbtree *, const size_t);
+
+// 배열에 쓴 key 수를 반환 (min(n, rbtree_size))
+size_t rbtree_to_array(const rbtree *, rbtree_key_t *, const size_t);
+size_t rbtree_to_array_parallel(const rbtree *, rbtree_key_t *, const size_t, const int);
+
+node_t *rbtree_next(const rbtree *, node_t *);
+node_t *rbtree_prev(const rbtree *, node_t *);
 
-int rbtree_to_array(const rbtree *, key_t *, const size_t);
+#ifdef RBTREE_INTERVAL
+// 구간 트리: [low, high] 닫힌 구간을 low 기준으로 저장 (RBTREE_INTERVAL로 빌드할 때만 노드에 구간 정보를 둠)
+node_t *rbtree_insert_interval(rbtree *, const rbtree_key_t, const rbtree_key_t);
+node_t *rbtree_overlap_first(const rbtree *, const rbtree_key_t, const rbtree_key_t);
+size_t rbtree_overlap_all(const rbtree *, const rbtree_key_t, const rbtree_key_t, node_t **, const size_t);
+#endif
 
 #endif  // _RBTREE_H_
\ No newline at end of file
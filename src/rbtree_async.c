@@ -0,0 +1,325 @@
+#include "rbtree_async.h"
+#include <stdlib.h>
+
+void *async_applier(void *arg);
+void async_apply_batch(async_rbtree *a, async_req_t *list);
+int async_req_comp(const async_req_t *r1, const async_req_t *r2);
+async_req_t *async_sort(async_req_t *list);
+void async_future_complete(void *arg, node_t *node, int status);
+
+/*
+📬 비동기 쓰기 front-end 생성 함수
+tree는 applier 스레드만 수정하며 메모리는 호출하는 쪽이 관리
+*/
+async_rbtree *new_async_rbtree(rbtree *tree)
+{
+  async_rbtree *a = (async_rbtree *)calloc(1, sizeof(async_rbtree));
+  if (a == NULL)
+  {
+    return NULL;
+  }
+
+  a->tree = tree;
+  atomic_init(&a->head, NULL);
+  atomic_init(&a->submitted, 0);
+  atomic_init(&a->sleeping, 0);
+  pthread_mutex_init(&a->lock, NULL);
+  pthread_cond_init(&a->wake, NULL);
+  pthread_cond_init(&a->applied, NULL);
+  pthread_rwlock_init(&a->tree_lock, NULL);
+
+  if (pthread_create(&a->applier, NULL, async_applier, a) != 0)
+  {
+    pthread_rwlock_destroy(&a->tree_lock);
+    pthread_cond_destroy(&a->applied);
+    pthread_cond_destroy(&a->wake);
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+    return NULL;
+  }
+
+  return a;
+}
+
+/*
+📬 남은 요청을 모두 적용한 뒤 applier 스레드를 멈추고 메모리를 반환하는 함수
+*/
+void delete_async_rbtree(async_rbtree *a)
+{
+  pthread_mutex_lock(&a->lock);
+  a->stop = 1;
+  pthread_cond_signal(&a->wake);
+  pthread_mutex_unlock(&a->lock);
+
+  pthread_join(a->applier, NULL);
+
+  pthread_rwlock_destroy(&a->tree_lock);
+  pthread_cond_destroy(&a->applied);
+  pthread_cond_destroy(&a->wake);
+  pthread_mutex_destroy(&a->lock);
+  free(a);
+}
+
+/*
+📬 요청을 큐에 넣는 함수 (성공하면 0, 메모리 할당에 실패하면 -1)
+producer끼리는 CAS로만 경쟁하므로 트리 작업을 기다리지 않음
+*/
+int async_rbtree_submit(async_rbtree *a, const async_op_t op, const rbtree_key_t key, async_callback_t cb, void *arg)
+{
+  async_req_t *req = (async_req_t *)malloc(sizeof(async_req_t));
+  if (req == NULL)
+  {
+    return -1;
+  }
+
+  req->op = op;
+  req->key = key;
+  req->cb = cb;
+  req->arg = arg;
+  req->node = NULL;
+  req->status = 0;
+  req->seq = atomic_fetch_add(&a->submitted, 1);
+
+  req->next = atomic_load(&a->head);
+  while (!atomic_compare_exchange_weak(&a->head, &req->next, req))
+  {
+  }
+
+  // applier가 잠들어 있을 때만 깨움 (sleeping과 head는 서로 반대 순서로 쓰고 읽음)
+  if (atomic_load(&a->sleeping))
+  {
+    pthread_mutex_lock(&a->lock);
+    pthread_cond_signal(&a->wake);
+    pthread_mutex_unlock(&a->lock);
+  }
+  return 0;
+}
+
+/*
+📬 insert/erase 요청 함수, future가 NULL이 아니면 적용 결과를 future로 받음
+*/
+int async_rbtree_insert(async_rbtree *a, const rbtree_key_t key, async_future *future)
+{
+  return async_rbtree_submit(a, ASYNC_INSERT, key, future == NULL ? NULL : async_future_complete, future);
+}
+
+int async_rbtree_erase(async_rbtree *a, const rbtree_key_t key, async_future *future)
+{
+  return async_rbtree_submit(a, ASYNC_ERASE, key, future == NULL ? NULL : async_future_complete, future);
+}
+
+/*
+📬 이 함수를 부르기 전에 넣은 요청이 모두 트리에 적용될 때까지 기다리는 함수
+flush 후 read lock을 잡고 읽으면 자신이 쓴 값을 볼 수 있음 (read-your-writes)
+*/
+void async_rbtree_flush(async_rbtree *a)
+{
+  const size_t ticket = atomic_load(&a->submitted);
+
+  pthread_mutex_lock(&a->lock);
+  while (a->done < ticket)
+  {
+    pthread_cond_wait(&a->applied, &a->lock);
+  }
+  pthread_mutex_unlock(&a->lock);
+}
+
+/*
+📬 applier가 배치를 적용하는 도중에 트리를 읽지 않도록 잡는 lock
+조회 캐시를 켠 트리는 rbtree_find도 캐시를 고치므로 읽는 쪽끼리도 하나씩 들어가도록 write lock을 잡음
+*/
+void async_rbtree_read_lock(async_rbtree *a)
+{
+  if (a->tree->cache != NULL)
+  {
+    pthread_rwlock_wrlock(&a->tree_lock);
+    return;
+  }
+  pthread_rwlock_rdlock(&a->tree_lock);
+}
+
+void async_rbtree_read_unlock(async_rbtree *a)
+{
+  pthread_rwlock_unlock(&a->tree_lock);
+}
+
+/*
+📬 applier 스레드: 큐를 통째로 가져와 배치로 적용하고, 비어 있으면 잠듦
+*/
+void *async_applier(void *arg)
+{
+  async_rbtree *a = (async_rbtree *)arg;
+
+  for (;;)
+  {
+    async_req_t *list = atomic_exchange(&a->head, NULL);
+    if (list != NULL)
+    {
+      async_apply_batch(a, list);
+      continue;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    atomic_store(&a->sleeping, 1);
+    while (atomic_load(&a->head) == NULL && !a->stop)
+    {
+      pthread_cond_wait(&a->wake, &a->lock);
+    }
+    atomic_store(&a->sleeping, 0);
+    const int stop = a->stop && atomic_load(&a->head) == NULL;
+    pthread_mutex_unlock(&a->lock);
+
+    if (stop)
+    {
+      return NULL;
+    }
+  }
+}
+
+/*
+📬 배치 정렬 기준: key 오름차순, 같은 key는 제출 순서대로
+*/
+int async_req_comp(const async_req_t *r1, const async_req_t *r2)
+{
+  if (r1->key != r2->key)
+  {
+    return r1->key < r2->key ? -1 : 1;
+  }
+  return r1->seq < r2->seq ? -1 : (r1->seq > r2->seq);
+}
+
+/*
+📬 요청 리스트를 merge sort로 정렬하는 함수 (applier에서 추가 메모리 할당 없음)
+*/
+async_req_t *async_sort(async_req_t *list)
+{
+  if (list == NULL || list->next == NULL)
+  {
+    return list;
+  }
+
+  // 느린/빠른 포인터로 리스트를 반으로 나눔
+  async_req_t *slow = list;
+  async_req_t *fast = list->next;
+  while (fast != NULL && fast->next != NULL)
+  {
+    slow = slow->next;
+    fast = fast->next->next;
+  }
+  async_req_t *right = slow->next;
+  slow->next = NULL;
+
+  async_req_t *l = async_sort(list);
+  async_req_t *r = async_sort(right);
+
+  async_req_t head;
+  async_req_t *tail = &head;
+  while (l != NULL && r != NULL)
+  {
+    if (async_req_comp(l, r) <= 0)
+    {
+      tail->next = l;
+      l = l->next;
+    }
+    else
+    {
+      tail->next = r;
+      r = r->next;
+    }
+    tail = tail->next;
+  }
+  tail->next = l != NULL ? l : r;
+  return head.next;
+}
+
+/*
+📬 가져온 요청들을 key 순서로 정렬해 트리에 적용하는 함수
+정렬된 순서로 적용하면 인접한 key의 탐색 경로가 캐시에 남아 있음
+*/
+void async_apply_batch(async_rbtree *a, async_req_t *list)
+{
+  list = async_sort(list);
+
+  size_t n = 0;
+  pthread_rwlock_wrlock(&a->tree_lock);
+  for (async_req_t *r = list; r != NULL; r = r->next)
+  {
+    if (r->op == ASYNC_INSERT)
+    {
+      r->node = rbtree_insert(a->tree, r->key);
+      r->status = r->node == NULL ? -1 : 0;
+    }
+    else
+    {
+      node_t *p = rbtree_find(a->tree, r->key);
+      r->status = p == NULL ? -1 : rbtree_erase(a->tree, p);
+    }
+    n++;
+  }
+  pthread_rwlock_unlock(&a->tree_lock);
+
+  // 완료 알림은 트리 lock을 놓은 뒤에 호출 (callback 안에서 읽기 가능)
+  while (list != NULL)
+  {
+    async_req_t *next = list->next;
+    if (list->cb != NULL)
+    {
+      list->cb(list->arg, list->node, list->status);
+    }
+    free(list);
+    list = next;
+  }
+
+  pthread_mutex_lock(&a->lock);
+  a->done += n;
+  pthread_cond_broadcast(&a->applied);
+  pthread_mutex_unlock(&a->lock);
+}
+
+/*
+📬 future 초기화/대기/정리 함수
+*/
+void async_future_init(async_future *f)
+{
+  pthread_mutex_init(&f->lock, NULL);
+  pthread_cond_init(&f->cond, NULL);
+  f->done = 0;
+  f->status = 0;
+  f->node = NULL;
+}
+
+void async_future_complete(void *arg, node_t *node, int status)
+{
+  async_future *f = (async_future *)arg;
+  pthread_mutex_lock(&f->lock);
+  f->node = node;
+  f->status = status;
+  f->done = 1;
+  pthread_cond_broadcast(&f->cond);
+  pthread_mutex_unlock(&f->lock);
+}
+
+/*
+📬 요청이 적용될 때까지 기다린 뒤 결과 노드를 반환하는 함수 (status가 NULL이 아니면 상태도 전달)
+*/
+node_t *async_future_wait(async_future *f, int *status)
+{
+  pthread_mutex_lock(&f->lock);
+  while (!f->done)
+  {
+    pthread_cond_wait(&f->cond, &f->lock);
+  }
+  node_t *node = f->node;
+  if (status != NULL)
+  {
+    *status = f->status;
+  }
+  pthread_mutex_unlock(&f->lock);
+  return node;
+}
+
+void async_future_destroy(async_future *f)
+{
+  pthread_cond_destroy(&f->cond);
+  pthread_mutex_destroy(&f->lock);
+}
@@ -0,0 +1,69 @@
+#ifndef _RBTREE_ASYNC_H_
+#define _RBTREE_ASYNC_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "rbtree.h"
+
+typedef enum { ASYNC_INSERT, ASYNC_ERASE } async_op_t;
+
+// 적용이 끝나면 applier 스레드에서 호출됨
+// insert는 새 노드, erase는 NULL을 node로 받고 status는 성공 0, 실패 -1
+typedef void (*async_callback_t)(void *arg, node_t *node, int status);
+
+// 결과를 기다릴 수 있는 future (호출하는 쪽에서 메모리를 준비)
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int done;
+  int status;
+  node_t *node;
+} async_future;
+
+typedef struct async_req_t {
+  struct async_req_t *next;
+  async_op_t op;
+  rbtree_key_t key;
+  size_t seq;  // 배치 안에서 같은 key의 요청 순서를 지키기 위한 번호
+  async_callback_t cb;
+  void *arg;
+  node_t *node;  // 적용 결과
+  int status;
+} async_req_t;
+
+typedef struct {
+  rbtree *tree;
+  _Atomic(async_req_t *) head;  // lock-free MPSC 스택, applier가 통째로 가져감
+  atomic_size_t submitted;
+  atomic_int sleeping;
+
+  pthread_t applier;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;     // applier를 깨움
+  pthread_cond_t applied;  // flush 대기자를 깨움
+  size_t done;             // 적용이 끝난 요청 수 (lock으로 보호)
+  int stop;
+
+  pthread_rwlock_t tree_lock;  // applier가 배치를 적용하는 동안 write lock
+} async_rbtree;
+
+async_rbtree *new_async_rbtree(rbtree *);
+void delete_async_rbtree(async_rbtree *);
+
+int async_rbtree_submit(async_rbtree *, const async_op_t, const rbtree_key_t, async_callback_t, void *);
+int async_rbtree_insert(async_rbtree *, const rbtree_key_t, async_future *);
+int async_rbtree_erase(async_rbtree *, const rbtree_key_t, async_future *);
+void async_rbtree_flush(async_rbtree *);
+
+// read lock을 잡은 동안에는 applier가 트리를 고치지 않음
+// 조회 캐시를 켠 트리(rbtree_enable_cache)는 find도 캐시를 고치므로 읽는 쪽끼리도 한 번에 하나씩만 들어감
+// (캐시는 front-end를 만들기 전이나 아무도 읽지 않을 때 켜고 꺼야 함)
+void async_rbtree_read_lock(async_rbtree *);
+void async_rbtree_read_unlock(async_rbtree *);
+
+void async_future_init(async_future *);
+node_t *async_future_wait(async_future *, int *);
+void async_future_destroy(async_future *);
+
+#endif  // _RBTREE_ASYNC_H_
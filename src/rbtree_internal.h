@@ -0,0 +1,21 @@
+#ifndef _RBTREE_INTERNAL_H_
+#define _RBTREE_INTERNAL_H_
+
+#include "rbtree.h"
+#include <stdint.h>
+
+// 라이브러리 안에서만 쓰는 함수 (bucket_tree처럼 노드를 다른 구조체에 내장하는 모듈용)
+
+// 호출하는 쪽이 할당한 노드를 연결/분리
+// 모든 트리 모드에서 경계 노드, tombstone 수, compaction 커서, 조회 캐시 항목은 맞게 유지하지만
+// 용량 제한은 적용하지 않고 (연결해도 다른 노드를 밀어내지 않음) 캐시를 채우거나 트레이스를 남기지도 않음
+node_t *rbtree_link_node(rbtree *, node_t *);
+// 같은 key 사이의 순서가 중요할 때 노드를 pos 바로 다음 자리에 연결
+node_t *rbtree_link_after(rbtree *, node_t *, node_t *);
+void rbtree_unlink_node(rbtree *, node_t *);
+
+// 트레이스 재생용: 캐시와 트레이스를 거치지 않는 조회, 같은 key의 살아 있는 노드 중 앞선 노드 수 (tombstone이면 -1)
+node_t *find_node(const rbtree *, const rbtree_key_t);
+int64_t rbtree_equal_rank(const rbtree *, node_t *);
+
+#endif  // _RBTREE_INTERNAL_H_
@@ -0,0 +1,581 @@
+#include "rbtree_trace.h"
+#include "rbtree_internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// 기록 중인 트리 포인터와 트레이스 안의 번호 매핑
+typedef struct {
+  const void *tree;
+  uint32_t id;
+} trace_tree_t;
+
+// 아래 기록 상태는 모두 trace_lock으로 보호함
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_out = NULL;
+static int trace_env_checked = 0;
+static uint64_t trace_start_ns = 0;
+static trace_tree_t *trace_trees = NULL;
+static size_t trace_tree_count = 0;
+static size_t trace_tree_cap = 0;
+static uint32_t trace_next_id = 1;
+
+uint64_t trace_now_ns(void);
+int trace_open_locked(const char *path);
+void trace_close_locked(void);
+void trace_fail(const char *why);
+int trace_ready(void);
+int trace_creates(const trace_op_t op);
+uint32_t trace_tree_id(const trace_op_t op, const void *tree);
+void trace_write(const trace_op_t op, const uint32_t id, const int64_t key, const int64_t arg);
+int replay_reserve(trace_replay_t *r, const uint32_t id);
+int replay_reserve_arr(trace_replay_t *r, const int64_t n);
+node_t *replay_equal_nth(const rbtree *t, const rbtree_key_t key, int64_t rank);
+
+/*
+📼 단조 증가 시계를 나노초 단위로 읽는 함수
+*/
+uint64_t trace_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+📼 path에 트레이스 기록을 시작하는 함수 (성공하면 0, 실패하면 -1)
+*/
+int rbtree_trace_open(const char *path)
+{
+  pthread_mutex_lock(&trace_lock);
+  const int ret = trace_open_locked(path);
+  pthread_mutex_unlock(&trace_lock);
+  return ret;
+}
+
+/*
+📼 trace_lock을 잡은 상태에서 트레이스 파일을 여는 함수
+*/
+int trace_open_locked(const char *path)
+{
+  trace_close_locked();
+
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+  // 레코드마다 write 시스템 콜이 일어나지 않도록 큰 버퍼 사용
+  setvbuf(fp, NULL, _IOFBF, 1 << 20);
+  if (fwrite(RBTREE_TRACE_MAGIC, 1, 8, fp) != 8)
+  {
+    fclose(fp);
+    return -1;
+  }
+
+  trace_out = fp;
+  trace_start_ns = trace_now_ns();
+  trace_next_id = 1;
+  trace_tree_count = 0;
+
+  static int registered = 0;
+  if (!registered)
+  {
+    registered = 1;
+    atexit(rbtree_trace_close);
+  }
+  return 0;
+}
+
+/*
+📼 트레이스 파일을 닫는 함수 (프로그램 종료 시에도 자동으로 호출됨)
+*/
+void rbtree_trace_close(void)
+{
+  pthread_mutex_lock(&trace_lock);
+  trace_close_locked();
+  pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+📼 trace_lock을 잡은 상태에서 트레이스 파일을 닫는 함수
+*/
+void trace_close_locked(void)
+{
+  if (trace_out != NULL)
+  {
+    fclose(trace_out);
+    trace_out = NULL;
+  }
+  free(trace_trees);
+  trace_trees = NULL;
+  trace_tree_count = 0;
+  trace_tree_cap = 0;
+}
+
+/*
+📼 기록을 더 이어갈 수 없을 때 트레이스를 닫는 함수
+여기까지 쓴 레코드는 그대로 재생할 수 있고, 빠진 레코드가 섞인 트레이스를 남기지 않도록 이후 기록은 멈춤
+*/
+void trace_fail(const char *why)
+{
+  fprintf(stderr, "rbtree trace: %s, recording stopped\n", why);
+  trace_close_locked();
+}
+
+/*
+📼 트리를 만드는 레코드인지 확인하는 함수
+*/
+int trace_creates(const trace_op_t op)
+{
+  return op == TRACE_NEW || op == TRACE_NEW_BOUNDED || op == TRACE_NEW_LAZY || op == TRACE_CLONE ||
+         op == TRACE_FROM_SORTED;
+}
+
+/*
+📼 트리 포인터를 트레이스 번호로 바꾸는 함수
+트레이스를 열기 전에 만들어진 트리는 처음 만났을 때 TRACE_NEW를 대신 기록함 (재생하면 빈 트리에서 시작)
+*/
+uint32_t trace_tree_id(const trace_op_t op, const void *tree)
+{
+  // 같은 트리가 연속으로 쓰이는 경우가 대부분이므로 뒤에서부터 찾음
+  for (size_t i = trace_tree_count; i > 0; i--)
+  {
+    if (trace_trees[i - 1].tree == tree)
+    {
+      const uint32_t id = trace_trees[i - 1].id;
+      if (op == TRACE_DELETE)
+      {
+        trace_trees[i - 1] = trace_trees[--trace_tree_count];
+      }
+      return id;
+    }
+  }
+
+  if (trace_tree_count == trace_tree_cap)
+  {
+    const size_t cap = trace_tree_cap == 0 ? 16 : trace_tree_cap * 2;
+    trace_tree_t *trees = realloc(trace_trees, cap * sizeof(trace_tree_t));
+    if (trees == NULL)
+    {
+      trace_fail("out of memory for the tree table");
+      return 0;
+    }
+    trace_trees = trees;
+    trace_tree_cap = cap;
+  }
+
+  const uint32_t id = trace_next_id++;
+  if (!trace_creates(op))
+  {
+    trace_write(TRACE_NEW, id, 0, 0);
+  }
+  if (op != TRACE_DELETE)
+  {
+    trace_trees[trace_tree_count].tree = tree;
+    trace_trees[trace_tree_count].id = id;
+    trace_tree_count++;
+  }
+  return id;
+}
+
+/*
+📼 레코드 하나를 파일 버퍼에 쓰는 함수 (쓰지 못하면 기록을 멈춤)
+*/
+void trace_write(const trace_op_t op, const uint32_t id, const int64_t key, const int64_t arg)
+{
+  if (trace_out == NULL)
+  {
+    return;
+  }
+  trace_rec_t rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.ns = trace_now_ns() - trace_start_ns;
+  rec.tree = id;
+  rec.op = (uint8_t)op;
+  rec.key = key;
+  rec.arg = arg;
+  if (fwrite(&rec, sizeof(rec), 1, trace_out) != 1)
+  {
+    trace_fail("write failed");
+  }
+}
+
+/*
+📼 trace_lock을 잡은 상태에서 기록할 트레이스가 열려 있는지 확인하는 함수
+트레이스가 열려 있지 않으면 처음 한 번만 RBTREE_TRACE_FILE 환경 변수를 확인함
+*/
+int trace_ready(void)
+{
+  if (trace_out != NULL)
+  {
+    return 1;
+  }
+  if (trace_env_checked)
+  {
+    return 0;
+  }
+  trace_env_checked = 1;
+  const char *path = getenv(RBTREE_TRACE_ENV);
+  return path != NULL && trace_open_locked(path) == 0;
+}
+
+/*
+📼 공개 함수 호출 하나를 기록하는 함수
+*/
+void rbtree_trace_record(const trace_op_t op, const void *tree, const int64_t key, const int64_t arg)
+{
+  if (tree == NULL)
+  {
+    return; // 만들지 못한 트리
+  }
+  pthread_mutex_lock(&trace_lock);
+  if (trace_ready())
+  {
+    const uint32_t id = trace_tree_id(op, tree);
+    if (id != 0)
+    {
+      trace_write(op, id, key, arg);
+    }
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+📼 src를 복제해서 tree를 만든 것을 기록하는 함수
+*/
+void rbtree_trace_record_clone(const void *tree, const void *src)
+{
+  if (tree == NULL)
+  {
+    return;
+  }
+  pthread_mutex_lock(&trace_lock);
+  if (trace_ready())
+  {
+    const uint32_t src_id = trace_tree_id(TRACE_FIND, src);
+    const uint32_t id = trace_tree_id(TRACE_CLONE, tree);
+    if (src_id != 0 && id != 0)
+    {
+      trace_write(TRACE_CLONE, id, 0, src_id);
+    }
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+📼 정렬된 배열 arr[0..n)로 tree를 만든 것을 기록하는 함수 (배열의 원소도 모두 기록)
+*/
+void rbtree_trace_record_build(const void *tree, const rbtree_key_t *arr, const size_t n, const int nthreads)
+{
+  if (tree == NULL)
+  {
+    return;
+  }
+  pthread_mutex_lock(&trace_lock);
+  if (trace_ready())
+  {
+    const uint32_t id = trace_tree_id(TRACE_FROM_SORTED, tree);
+    if (id != 0)
+    {
+      trace_write(TRACE_FROM_SORTED, id, (int64_t)n, nthreads);
+      for (size_t i = 0; i < n; i++)
+      {
+        trace_write(TRACE_SORTED_KEY, id, arr[i], 0);
+      }
+    }
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+📼 트레이스 파일을 읽기용으로 열고 magic을 확인하는 함수 (실패하면 NULL)
+*/
+FILE *rbtree_trace_open_read(const char *path)
+{
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL)
+  {
+    return NULL;
+  }
+  char magic[8];
+  if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, RBTREE_TRACE_MAGIC, 8) != 0)
+  {
+    fclose(fp);
+    return NULL;
+  }
+  return fp;
+}
+
+/*
+📼 다음 레코드를 읽는 함수 (읽었으면 1, 끝이면 0, 잘린 레코드나 모르는 op면 -1)
+*/
+int rbtree_trace_next(FILE *fp, trace_rec_t *rec)
+{
+  const size_t got = fread(rec, 1, sizeof(trace_rec_t), fp);
+  if (got == 0 && feof(fp))
+  {
+    return 0;
+  }
+  return got == sizeof(trace_rec_t) && rec->op < TRACE_OP_COUNT ? 1 : -1;
+}
+
+/*
+📼 트레이스 재생을 시작하는 함수 (성공하면 0, 읽을 수 없는 트레이스면 -1)
+*/
+int rbtree_trace_replay_open(trace_replay_t *r, const char *path)
+{
+  memset(r, 0, sizeof(*r));
+  r->fp = rbtree_trace_open_read(path);
+  return r->fp == NULL ? -1 : 0;
+}
+
+/*
+📼 트리 번호 id까지 담을 수 있도록 재생 상태의 배열을 늘리는 함수
+*/
+int replay_reserve(trace_replay_t *r, const uint32_t id)
+{
+  if (id < r->n_trees)
+  {
+    return 0;
+  }
+  const size_t cap = (size_t)id + 16;
+  rbtree **trees = realloc(r->trees, cap * sizeof(rbtree *));
+  if (trees == NULL)
+  {
+    return -1;
+  }
+  r->trees = trees;
+  node_t **last = realloc(r->last, cap * sizeof(node_t *));
+  if (last == NULL)
+  {
+    return -1;
+  }
+  r->last = last;
+  memset(r->trees + r->n_trees, 0, (cap - r->n_trees) * sizeof(rbtree *));
+  memset(r->last + r->n_trees, 0, (cap - r->n_trees) * sizeof(node_t *));
+  r->n_trees = cap;
+  return 0;
+}
+
+/*
+📼 key 배열을 n개 이상으로 늘리는 함수
+*/
+int replay_reserve_arr(trace_replay_t *r, const int64_t n)
+{
+  if (n < 0)
+  {
+    return -1;
+  }
+  if ((size_t)n <= r->arr_cap)
+  {
+    return 0;
+  }
+  rbtree_key_t *arr = realloc(r->arr, (size_t)n * sizeof(rbtree_key_t));
+  if (arr == NULL)
+  {
+    return -1;
+  }
+  r->arr = arr;
+  r->arr_cap = (size_t)n;
+  return 0;
+}
+
+/*
+📼 같은 key의 살아 있는 노드 중 rank번째 노드를 찾는 함수 (없으면 NULL)
+캐시를 거치지 않으므로 재생 중인 트리의 캐시 상태를 바꾸지 않음
+*/
+node_t *replay_equal_nth(const rbtree *t, const rbtree_key_t key, int64_t rank)
+{
+  node_t *p = find_node(t, key);
+  if (p == NULL)
+  {
+    return NULL;
+  }
+  for (node_t *q = rbtree_prev(t, p); q != NULL && q->key == key; q = rbtree_prev(t, q))
+  {
+    p = q;
+  }
+  while (p != NULL && rank-- > 0)
+  {
+    p = rbtree_next(t, p);
+  }
+  return p != NULL && p->key == key ? p : NULL;
+}
+
+/*
+📼 다음 레코드를 읽고 실행할 준비를 하는 함수 (준비됐으면 1, 끝이면 0, 잘못됐거나 재생할 수 없는 레코드면 -1)
+시간을 재지 않아야 하는 일은 여기서 끝냄: 버퍼 확보, from_sorted_array의 배열 읽기, erase 대상 찾기
+erase 레코드에는 같은 key 중 몇 번째 노드인지가 들어 있어서 같은 key가 여럿이어도 기록한 프로그램과 같은 노드를 지움
+대상은 보통 바로 앞의 insert/find/min/max가 돌려준 노드이므로 그 노드의 순서만 확인하고, 아닐 때만 다시 찾음
+tombstone을 다시 erase한 레코드(순서 -1)는 아무것도 바꾸지 않았으므로 재생에서도 건너뜀
+*/
+int rbtree_trace_replay_next(trace_replay_t *r, trace_rec_t *rec)
+{
+  const int got = rbtree_trace_next(r->fp, rec);
+  if (got <= 0)
+  {
+    return got;
+  }
+  if (rec->tree == 0 || replay_reserve(r, rec->tree) != 0)
+  {
+    return -1;
+  }
+  rbtree *t = r->trees[rec->tree];
+  if (trace_creates(rec->op) != (t == NULL))
+  {
+    return -1; // 없는 트리를 쓰거나 이미 있는 번호로 다시 만드는 트레이스
+  }
+
+  switch (rec->op)
+  {
+  case TRACE_CLONE:
+    if (rec->arg <= 0 || (size_t)rec->arg >= r->n_trees || r->trees[rec->arg] == NULL)
+    {
+      return -1;
+    }
+    break;
+  case TRACE_FROM_SORTED:
+    if (replay_reserve_arr(r, rec->key) != 0)
+    {
+      return -1;
+    }
+    for (int64_t i = 0; i < rec->key; i++)
+    {
+      trace_rec_t elem;
+      if (rbtree_trace_next(r->fp, &elem) != 1 || elem.op != TRACE_SORTED_KEY || elem.tree != rec->tree)
+      {
+        return -1;
+      }
+      r->arr[i] = (rbtree_key_t)elem.key;
+    }
+    break;
+  case TRACE_SORTED_KEY:
+    return -1; // TRACE_FROM_SORTED 없이 나온 배열 원소
+  case TRACE_TO_ARRAY:
+    if (replay_reserve_arr(r, rec->key) != 0)
+    {
+      return -1;
+    }
+    break;
+  case TRACE_ERASE:
+    r->target = NULL;
+    if (rec->arg >= 0)
+    {
+      node_t *p = r->last[rec->tree];
+      if (p == NULL || p->key != (rbtree_key_t)rec->key || rbtree_equal_rank(t, p) != rec->arg)
+      {
+        p = replay_equal_nth(t, (rbtree_key_t)rec->key, rec->arg);
+      }
+      if (p == NULL)
+      {
+        return -1; // 기록한 트리와 모양이 달라짐
+      }
+      r->target = p;
+    }
+    break;
+  case TRACE_INSERT_INTERVAL:
+#ifndef RBTREE_INTERVAL
+    return -1; // 구간 트리 없이 빌드됨
+#endif
+    break;
+  }
+  return 1;
+}
+
+/*
+📼 rbtree_trace_replay_next로 준비한 레코드를 실행하는 함수
+*/
+void rbtree_trace_replay_apply(trace_replay_t *r, const trace_rec_t *rec)
+{
+  rbtree *t = r->trees[rec->tree];
+  node_t **last = &r->last[rec->tree];
+  node_t *p;
+  switch (rec->op)
+  {
+  case TRACE_NEW:
+    r->trees[rec->tree] = new_rbtree();
+    break;
+  case TRACE_NEW_BOUNDED:
+    r->trees[rec->tree] = new_bounded_rbtree((size_t)rec->key, (keep_t)rec->arg);
+    break;
+  case TRACE_NEW_LAZY:
+    r->trees[rec->tree] = new_lazy_rbtree(trace_bits_double(rec->arg));
+    break;
+  case TRACE_CLONE:
+    r->trees[rec->tree] = rbtree_clone(r->trees[rec->arg]);
+    break;
+  case TRACE_FROM_SORTED:
+    r->trees[rec->tree] = rbtree_from_sorted_array(r->arr, (size_t)rec->key, (int)rec->arg);
+    break;
+  case TRACE_DELETE:
+    delete_rbtree(t);
+    r->trees[rec->tree] = NULL;
+    *last = NULL;
+    break;
+  case TRACE_INSERT:
+    *last = rbtree_insert(t, (rbtree_key_t)rec->key);
+    break;
+#ifdef RBTREE_INTERVAL
+  case TRACE_INSERT_INTERVAL:
+    *last = rbtree_insert_interval(t, (rbtree_key_t)rec->key, (rbtree_key_t)rec->arg);
+    break;
+#endif
+  case TRACE_FIND:
+    *last = rbtree_find(t, (rbtree_key_t)rec->key);
+    break;
+  case TRACE_MIN:
+  case TRACE_MAX:
+    p = rec->op == TRACE_MIN ? rbtree_min(t) : rbtree_max(t);
+    *last = p == t->nil ? NULL : p;
+    break;
+  case TRACE_ERASE:
+    if (r->target != NULL)
+    {
+      rbtree_erase(t, r->target);
+    }
+    r->target = NULL;
+    *last = NULL;
+    break;
+  case TRACE_TO_ARRAY:
+    rbtree_to_array_parallel(t, r->arr, (size_t)rec->key, (int)rec->arg);
+    break;
+  case TRACE_ENABLE_CACHE:
+    rbtree_enable_cache(t, (size_t)rec->key);
+    break;
+  case TRACE_COMPACT:
+    rbtree_compact(t, (size_t)rec->key);
+    break;
+  }
+}
+
+/*
+📼 트레이스 번호 id의 재생 중인 트리를 반환하는 함수 (없으면 NULL)
+*/
+rbtree *rbtree_trace_replay_tree(const trace_replay_t *r, const uint32_t id)
+{
+  return id < r->n_trees ? r->trees[id] : NULL;
+}
+
+/*
+📼 재생을 끝내고 남은 트리와 버퍼를 해제하는 함수
+*/
+void rbtree_trace_replay_close(trace_replay_t *r)
+{
+  for (size_t i = 0; i < r->n_trees; i++)
+  {
+    if (r->trees[i] != NULL)
+    {
+      delete_rbtree(r->trees[i]);
+    }
+  }
+  free(r->trees);
+  free(r->last);
+  free(r->arr);
+  if (r->fp != NULL)
+  {
+    fclose(r->fp);
+  }
+  memset(r, 0, sizeof(*r));
+}
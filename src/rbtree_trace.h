@@ -0,0 +1,83 @@
+#ifndef _RBTREE_TRACE_H_
+#define _RBTREE_TRACE_H_
+
+#include "rbtree.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define RBTREE_TRACE_MAGIC "RBTRACE2"
+#define RBTREE_TRACE_ENV "RBTREE_TRACE_FILE"
+
+// 주석은 key와 arg에 담기는 값 (적혀 있지 않으면 0)
+typedef enum {
+  TRACE_NEW,
+  TRACE_DELETE,
+  TRACE_INSERT,           // key
+  TRACE_FIND,             // key
+  TRACE_ERASE,            // 지운 노드의 key, 같은 key의 살아 있는 노드 중 순서 (tombstone이면 -1)
+  TRACE_MIN,
+  TRACE_MAX,
+  TRACE_TO_ARRAY,         // n, nthreads
+  TRACE_NEW_BOUNDED,      // capacity, keep
+  TRACE_NEW_LAZY,         // 0, max_dead의 비트 (trace_double_bits)
+  TRACE_CLONE,            // 0, 원본 트리 번호
+  TRACE_FROM_SORTED,      // n, nthreads (뒤에 TRACE_SORTED_KEY 레코드 n개가 이어짐)
+  TRACE_SORTED_KEY,       // from_sorted_array에 넘긴 배열의 원소
+  TRACE_INSERT_INTERVAL,  // low, high
+  TRACE_ENABLE_CACHE,     // sets
+  TRACE_COMPACT,          // budget
+  TRACE_OP_COUNT
+} trace_op_t;
+
+// 트레이스 파일은 magic 8바이트 뒤에 고정 길이 레코드가 이어짐
+typedef struct {
+  uint64_t ns;    // 트레이스를 연 이후 경과 시간
+  uint32_t tree;  // 트리 식별 번호 (트리를 만든 순서대로 1부터)
+  uint8_t op;     // trace_op_t
+  uint8_t pad[3];
+  int64_t key;
+  int64_t arg;
+} trace_rec_t;
+
+static inline int64_t trace_double_bits(const double x) {
+  int64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+static inline double trace_bits_double(const int64_t bits) {
+  double x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// 기록 함수들은 내부 mutex로 직렬화되므로 여러 스레드에서 불러도 되고,
+// 레코드는 mutex를 잡은 순서대로 파일에 남음
+int rbtree_trace_open(const char *);
+void rbtree_trace_close(void);
+void rbtree_trace_record(const trace_op_t, const void *, const int64_t, const int64_t);
+void rbtree_trace_record_clone(const void *, const void *);
+void rbtree_trace_record_build(const void *, const rbtree_key_t *, const size_t, const int);
+
+FILE *rbtree_trace_open_read(const char *);
+int rbtree_trace_next(FILE *, trace_rec_t *);
+
+// 트레이스 재생 상태 (트레이스의 트리 번호마다 재생 중인 트리를 둠)
+typedef struct {
+  FILE *fp;
+  rbtree **trees;
+  node_t **last;        // 트리마다 insert/find/min/max가 마지막으로 돌려준 노드
+  size_t n_trees;
+  rbtree_key_t *arr;    // to_array 출력, from_sorted_array 입력
+  size_t arr_cap;
+  node_t *target;       // 준비해 둔 erase 대상 (없으면 NULL)
+} trace_replay_t;
+
+int rbtree_trace_replay_open(trace_replay_t *, const char *);
+int rbtree_trace_replay_next(trace_replay_t *, trace_rec_t *);
+void rbtree_trace_replay_apply(trace_replay_t *, const trace_rec_t *);
+rbtree *rbtree_trace_replay_tree(const trace_replay_t *, const uint32_t);
+void rbtree_trace_replay_close(trace_replay_t *);
+
+#endif  // _RBTREE_TRACE_H_
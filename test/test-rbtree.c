@@ -1,8 +1,18 @@
 #include <assert.h>
+#include <bucket_tree.h>
+#include <pthread.h>
 #include <rbtree.h>
+#include <rbtree_async.h>
+#include <rbtree_internal.h>
+#include <rbtree_trace.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef RBTREE_KEY64
+#include <sys/ipc.h>
+#include <sys/types.h>
+#endif
 
 // new_rbtree should return rbtree struct with null root node
 void test_init(void) {
@@ -18,7 +28,7 @@ void test_init(void) {
 }
 
 // root node should have proper values and pointers
-void test_insert_single(const key_t key) {
+void test_insert_single(const rbtree_key_t key) {
   rbtree *t = new_rbtree();
   node_t *p = rbtree_insert(t, key);
   assert(p != NULL);
@@ -38,7 +48,7 @@ void test_insert_single(const key_t key) {
 }
 
 // find should return the node with the key or NULL if no such node exists
-void test_find_single(const key_t key, const key_t wrong_key) {
+void test_find_single(const rbtree_key_t key, const rbtree_key_t wrong_key) {
   rbtree *t = new_rbtree();
   node_t *p = rbtree_insert(t, key);
 
@@ -54,7 +64,7 @@ void test_find_single(const key_t key, const key_t wrong_key) {
 }
 
 // erase should delete root node
-void test_erase_root(const key_t key) {
+void test_erase_root(const rbtree_key_t key) {
   rbtree *t = new_rbtree();
   node_t *p = rbtree_insert(t, key);
   assert(p != NULL);
@@ -71,15 +81,15 @@ void test_erase_root(const key_t key) {
   delete_rbtree(t);
 }
 
-static void insert_arr(rbtree *t, const key_t *arr, const size_t n) {
+static void insert_arr(rbtree *t, const rbtree_key_t *arr, const size_t n) {
   for (size_t i = 0; i < n; i++) {
     rbtree_insert(t, arr[i]);
   }
 }
 
 static int comp(const void *p1, const void *p2) {
-  const key_t *e1 = (const key_t *)p1;
-  const key_t *e2 = (const key_t *)p2;
+  const rbtree_key_t *e1 = (const rbtree_key_t *)p1;
+  const rbtree_key_t *e2 = (const rbtree_key_t *)p2;
   if (*e1 < *e2) {
     return -1;
   } else if (*e1 > *e2) {
@@ -90,7 +100,7 @@ static int comp(const void *p1, const void *p2) {
 };
 
 // min/max should return the min/max value of the tree
-void test_minmax(key_t *arr, const size_t n) {
+void test_minmax(rbtree_key_t *arr, const size_t n) {
   // null array is not allowed
   assert(n > 0 && arr != NULL);
 
@@ -103,7 +113,7 @@ void test_minmax(key_t *arr, const size_t n) {
   assert(t->root != t->nil);
 #endif
 
-  qsort((void *)arr, n, sizeof(key_t), comp);
+  qsort((void *)arr, n, sizeof(rbtree_key_t), comp);
   node_t *p = rbtree_min(t);
   assert(p != NULL);
   assert(p->key == arr[0]);
@@ -127,13 +137,13 @@ void test_minmax(key_t *arr, const size_t n) {
   delete_rbtree(t);
 }
 
-void test_to_array(rbtree *t, const key_t *arr, const size_t n) {
+void test_to_array(rbtree *t, const rbtree_key_t *arr, const size_t n) {
   assert(t != NULL);
 
   insert_arr(t, arr, n);
-  qsort((void *)arr, n, sizeof(key_t), comp);
+  qsort((void *)arr, n, sizeof(rbtree_key_t), comp);
 
-  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_key_t *res = calloc(n, sizeof(rbtree_key_t));
   rbtree_to_array(t, res, n);
   for (int i = 0; i < n; i++) {
     assert(arr[i] == res[i]);
@@ -147,23 +157,23 @@ void test_multi_instance() {
   rbtree *t2 = new_rbtree();
   assert(t2 != NULL);
 
-  key_t arr1[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  rbtree_key_t arr1[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
   const size_t n1 = sizeof(arr1) / sizeof(arr1[0]);
   insert_arr(t1, arr1, n1);
-  qsort((void *)arr1, n1, sizeof(key_t), comp);
+  qsort((void *)arr1, n1, sizeof(rbtree_key_t), comp);
 
-  key_t arr2[] = {4, 8, 10, 5, 3};
+  rbtree_key_t arr2[] = {4, 8, 10, 5, 3};
   const size_t n2 = sizeof(arr2) / sizeof(arr2[0]);
   insert_arr(t2, arr2, n2);
-  qsort((void *)arr2, n2, sizeof(key_t), comp);
+  qsort((void *)arr2, n2, sizeof(rbtree_key_t), comp);
 
-  key_t *res1 = calloc(n1, sizeof(key_t));
+  rbtree_key_t *res1 = calloc(n1, sizeof(rbtree_key_t));
   rbtree_to_array(t1, res1, n1);
   for (int i = 0; i < n1; i++) {
     assert(arr1[i] == res1[i]);
   }
 
-  key_t *res2 = calloc(n2, sizeof(key_t));
+  rbtree_key_t *res2 = calloc(n2, sizeof(rbtree_key_t));
   rbtree_to_array(t2, res2, n2);
   for (int i = 0; i < n2; i++) {
     assert(arr2[i] == res2[i]);
@@ -180,7 +190,7 @@ void test_multi_instance() {
 // The values of right subtree should be greater than or equal to the current
 // node
 
-static bool search_traverse(const node_t *p, key_t *min, key_t *max,
+static bool search_traverse(const node_t *p, rbtree_key_t *min, rbtree_key_t *max,
                             node_t *nil) {
   if (p == nil) {
     return true;
@@ -188,7 +198,7 @@ static bool search_traverse(const node_t *p, key_t *min, key_t *max,
 
   *min = *max = p->key;
 
-  key_t l_min, l_max, r_min, r_max;
+  rbtree_key_t l_min, l_max, r_min, r_max;
   l_min = l_max = r_min = r_max = p->key;
 
   const bool lr = search_traverse(p->left, &l_min, &l_max, nil);
@@ -208,7 +218,7 @@ static bool search_traverse(const node_t *p, key_t *min, key_t *max,
 void test_search_constraint(const rbtree *t) {
   assert(t != NULL);
   node_t *p = t->root;
-  key_t min, max;
+  rbtree_key_t min, max;
 #ifdef SENTINEL
   node_t *nil = t->nil;
 #else
@@ -266,7 +276,7 @@ void test_color_constraint(const rbtree *t) {
 }
 
 // rbtree should keep search tree and color constraints
-void test_rb_constraints(const key_t arr[], const size_t n) {
+void test_rb_constraints(const rbtree_key_t arr[], const size_t n) {
   rbtree *t = new_rbtree();
   assert(t != NULL);
 
@@ -281,20 +291,20 @@ void test_rb_constraints(const key_t arr[], const size_t n) {
 
 // rbtree should manage distinct values
 void test_distinct_values() {
-  const key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12};
+  const rbtree_key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12};
   const size_t n = sizeof(entries) / sizeof(entries[0]);
   test_rb_constraints(entries, n);
 }
 
 // rbtree should manage values with duplicate
 void test_duplicate_values() {
-  const key_t entries[] = {10, 5, 5, 34, 6, 23, 12, 12, 6, 12};
+  const rbtree_key_t entries[] = {10, 5, 5, 34, 6, 23, 12, 12, 6, 12};
   const size_t n = sizeof(entries) / sizeof(entries[0]);
   test_rb_constraints(entries, n);
 }
 
 void test_minmax_suite() {
-  key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12};
+  rbtree_key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12};
   const size_t n = sizeof(entries) / sizeof(entries[0]);
   test_minmax(entries, n);
 }
@@ -303,14 +313,14 @@ void test_to_array_suite() {
   rbtree *t = new_rbtree();
   assert(t != NULL);
 
-  key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  rbtree_key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
   const size_t n = sizeof(entries) / sizeof(entries[0]);
   test_to_array(t, entries, n);
 
   delete_rbtree(t);
 }
 
-void test_find_erase(rbtree *t, const key_t *arr, const size_t n) {
+void test_find_erase(rbtree *t, const rbtree_key_t *arr, const size_t n) {
   for (int i = 0; i < n; i++) {
     node_t *p = rbtree_insert(t, arr[i]);
     assert(p != NULL);
@@ -343,7 +353,7 @@ void test_find_erase(rbtree *t, const key_t *arr, const size_t n) {
 }
 
 void test_find_erase_fixed() {
-  const key_t arr[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const rbtree_key_t arr[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
   const size_t n = sizeof(arr) / sizeof(arr[0]);
   rbtree *t = new_rbtree();
   assert(t != NULL);
@@ -356,7 +366,7 @@ void test_find_erase_fixed() {
 void test_find_erase_rand(const size_t n, const unsigned int seed) {
   srand(seed);
   rbtree *t = new_rbtree();
-  key_t *arr = calloc(n, sizeof(key_t));
+  rbtree_key_t *arr = calloc(n, sizeof(rbtree_key_t));
   for (int i = 0; i < n; i++) {
     arr[i] = rand();
   }
@@ -367,6 +377,1077 @@ void test_find_erase_rand(const size_t n, const unsigned int seed) {
   delete_rbtree(t);
 }
 
+#ifdef RBTREE_INTERVAL
+// max_high of every node should be the max high of its subtree
+static rbtree_key_t max_high_traverse(const node_t *p, const node_t *nil) {
+  if (p == nil) {
+    return RBTREE_KEY_MIN;
+  }
+  rbtree_key_t m = p->high;
+  const rbtree_key_t l = max_high_traverse(p->left, nil);
+  const rbtree_key_t r = max_high_traverse(p->right, nil);
+  if (l > m) m = l;
+  if (r > m) m = r;
+  assert(p->max_high == m);
+  return m;
+}
+
+static bool overlaps(const node_t *p, const rbtree_key_t low, const rbtree_key_t high) {
+  return p->key <= high && low <= p->high;
+}
+
+// overlap queries should agree with a brute-force scan
+void test_interval_rand(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  node_t **nodes = calloc(n, sizeof(node_t *));
+  node_t **res = calloc(n, sizeof(node_t *));
+  for (size_t i = 0; i < n; i++) {
+    const rbtree_key_t low = rand() % 10000;
+    nodes[i] = rbtree_insert_interval(t, low, low + rand() % 100);
+    assert(nodes[i] != NULL);
+  }
+  // erase half of the intervals to exercise delete_fixup
+  size_t live = n;
+  for (size_t i = 0; i < n; i += 2) {
+    rbtree_erase(t, nodes[i]);
+    nodes[i] = NULL;
+    live--;
+  }
+#ifdef SENTINEL
+  max_high_traverse(t->root, t->nil);
+#else
+  max_high_traverse(t->root, NULL);
+#endif
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  for (int q = 0; q < 200; q++) {
+    const rbtree_key_t low = rand() % 10100;
+    const rbtree_key_t high = low + rand() % 50;
+    size_t expected = 0;
+    rbtree_key_t first = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (nodes[i] != NULL && overlaps(nodes[i], low, high)) {
+        if (expected == 0 || nodes[i]->key < first) {
+          first = nodes[i]->key;
+        }
+        expected++;
+      }
+    }
+    node_t *p = rbtree_overlap_first(t, low, high);
+    if (expected == 0) {
+      assert(p == NULL);
+    } else {
+      assert(p != NULL && overlaps(p, low, high) && p->key == first);
+    }
+    const size_t cnt = rbtree_overlap_all(t, low, high, res, live);
+    assert(cnt == expected);
+    for (size_t i = 0; i < cnt; i++) {
+      assert(overlaps(res[i], low, high));
+      assert(i == 0 || res[i - 1]->key <= res[i]->key);
+    }
+  }
+
+  free(res);
+  free(nodes);
+  delete_rbtree(t);
+}
+#endif
+
+// bounded tree should keep only the capacity largest (or smallest) keys
+void test_bounded_rand(const size_t n, const size_t capacity,
+                       const keep_t keep, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_bounded_rbtree(capacity, keep);
+  assert(t != NULL);
+  rbtree_key_t *arr = calloc(n, sizeof(rbtree_key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % 5000;
+    node_t *p = rbtree_insert(t, arr[i]);
+    assert(p == NULL || p->key == arr[i]);
+    assert(t->size <= capacity);
+    assert(t->bound != NULL);
+    node_t *edge = keep == RBTREE_KEEP_LARGEST ? rbtree_min(t) : rbtree_max(t);
+    assert(t->bound == edge);
+  }
+  assert(t->size == capacity);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  qsort((void *)arr, n, sizeof(rbtree_key_t), comp);
+  const rbtree_key_t *expected = keep == RBTREE_KEEP_LARGEST ? arr + n - capacity : arr;
+  rbtree_key_t *res = calloc(capacity, sizeof(rbtree_key_t));
+  rbtree_to_array(t, res, capacity);
+  for (size_t i = 0; i < capacity; i++) {
+    assert(res[i] == expected[i]);
+  }
+
+  // the internal unlink/link used by embedding structures keep the bound too
+  node_t *b = t->bound;
+  rbtree_unlink_node(t, b);
+  assert(t->size == 0 || t->bound == (keep == RBTREE_KEEP_LARGEST ? rbtree_min(t) : rbtree_max(t)));
+  rbtree_link_node(t, b);
+  assert(t->bound == (keep == RBTREE_KEEP_LARGEST ? rbtree_min(t) : rbtree_max(t)));
+
+  // erasing the bound node should move the bound to the next node
+  rbtree_erase(t, t->bound);
+  if (t->size == 0) {
+    assert(t->bound == NULL);
+  } else {
+    node_t *edge = keep == RBTREE_KEEP_LARGEST ? rbtree_min(t) : rbtree_max(t);
+    assert(t->bound == edge);
+  }
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// keys equal to the bound must not displace the older node at the edge
+void test_bounded_duplicates(const size_t n, const unsigned int seed) {
+  // evicting a bound that pointed at the later of two equal nodes skipped
+  // the older one and rejected the 6
+  rbtree *t = new_bounded_rbtree(3, RBTREE_KEEP_LARGEST);
+  const rbtree_key_t keys[] = {3, 5, 8, 5, 9, 6};
+  for (size_t i = 0; i < 6; i++) {
+    rbtree_insert(t, keys[i]);
+  }
+  rbtree_key_t res[3];
+  assert(rbtree_to_array(t, res, 3) == 3);
+  assert(res[0] == 6 && res[1] == 8 && res[2] == 9);
+  assert(t->bound == rbtree_min(t));
+  delete_rbtree(t);
+
+  srand(seed);
+  const keep_t modes[] = {RBTREE_KEEP_LARGEST, RBTREE_KEEP_SMALLEST};
+  rbtree_key_t *arr = calloc(n, sizeof(rbtree_key_t));
+  for (int m = 0; m < 2; m++) {
+    for (size_t capacity = 1; capacity <= 6; capacity++) {
+      t = new_bounded_rbtree(capacity, modes[m]);
+      for (size_t i = 0; i < n; i++) {
+        arr[i] = rand() % 6;
+        rbtree_insert(t, arr[i]);
+        node_t *edge = modes[m] == RBTREE_KEEP_LARGEST ? rbtree_min(t) : rbtree_max(t);
+        assert(t->bound == edge);
+      }
+      qsort((void *)arr, n, sizeof(rbtree_key_t), comp);
+      const rbtree_key_t *expected = modes[m] == RBTREE_KEEP_LARGEST ? arr + n - capacity : arr;
+      rbtree_key_t out[6];
+      assert(rbtree_to_array(t, out, capacity) == capacity);
+      assert(memcmp(out, expected, capacity * sizeof(rbtree_key_t)) == 0);
+      delete_rbtree(t);
+    }
+  }
+  free(arr);
+}
+
+// bucket tree should behave like the plain tree as a multiset
+void test_bucket_tree_rand(const size_t n, const unsigned int seed) {
+  srand(seed);
+  bucket_tree *t = new_bucket_tree();
+  assert(t != NULL);
+  assert(bucket_tree_min(t) == NULL && bucket_tree_max(t) == NULL);
+
+  rbtree_key_t *arr = calloc(n, sizeof(rbtree_key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (n / 2);  // force duplicates across buckets
+    assert(bucket_tree_insert(t, arr[i]) == 0);
+  }
+  assert(t->size == n);
+  for (size_t i = 0; i < n; i++) {
+    const rbtree_key_t *p = bucket_tree_find(t, arr[i]);
+    assert(p != NULL && *p == arr[i]);
+  }
+
+  // erase every other inserted key and compare against a sorted copy
+  for (size_t i = 0; i < n; i += 2) {
+    assert(bucket_tree_erase(t, arr[i]) == 0);
+  }
+  size_t m = 0;
+  for (size_t i = 1; i < n; i += 2) {
+    arr[m++] = arr[i];
+  }
+  assert(t->size == m);
+  qsort((void *)arr, m, sizeof(rbtree_key_t), comp);
+
+  rbtree_key_t *res = calloc(m, sizeof(rbtree_key_t));
+  bucket_tree_to_array(t, res, m);
+  for (size_t i = 0; i < m; i++) {
+    assert(res[i] == arr[i]);
+  }
+  assert(*bucket_tree_min(t) == arr[0]);
+  assert(*bucket_tree_max(t) == arr[m - 1]);
+  assert(bucket_tree_find(t, -1) == NULL);
+  assert(bucket_tree_erase(t, -1) == -1);
+
+  for (size_t i = 0; i < m; i++) {
+    assert(bucket_tree_erase(t, arr[i]) == 0);
+  }
+  assert(t->size == 0 && bucket_tree_min(t) == NULL);
+  test_color_constraint(t->index);
+
+  free(res);
+  free(arr);
+  delete_bucket_tree(t);
+}
+
+// check a bucket tree holds exactly the sorted keys in ref and can find each
+static void check_bucket_tree(const bucket_tree *t, rbtree_key_t *ref,
+                              const size_t n) {
+  assert(t->size == n);
+  qsort((void *)ref, n, sizeof(rbtree_key_t), comp);
+  rbtree_key_t *res = calloc(n, sizeof(rbtree_key_t));
+  assert(bucket_tree_to_array(t, res, n) == n);
+  for (size_t i = 0; i < n; i++) {
+    assert(res[i] == ref[i]);
+    const rbtree_key_t *p = bucket_tree_find(t, ref[i]);
+    assert(p != NULL && *p == ref[i]);
+  }
+  free(res);
+}
+
+// runs of equal keys longer than a bucket split into buckets sharing a
+// separator; the split-off half must stay next to its source bucket
+void test_bucket_tree_dup_runs(const size_t rounds, const unsigned int seed) {
+  bucket_tree *t = new_bucket_tree();
+  const size_t cap = 4096;
+  rbtree_key_t *ref = calloc(cap, sizeof(rbtree_key_t));
+  size_t n = 0;
+
+  // 5 x 33, 6 x 15, 5 x 17 used to leave 5..5 6..6 5..5 in the index
+  const rbtree_key_t keys[] = {5, 6, 5};
+  const int counts[] = {33, 15, 17};
+  for (int r = 0; r < 3; r++) {
+    for (int i = 0; i < counts[r]; i++) {
+      assert(bucket_tree_insert(t, keys[r]) == 0);
+      ref[n++] = keys[r];
+    }
+  }
+  check_bucket_tree(t, ref, n);
+
+  // interleave long runs of a few values, then erase some and recheck
+  srand(seed);
+  for (size_t r = 0; r < rounds; r++) {
+    const rbtree_key_t key = rand() % 8;
+    const int run = 1 + rand() % (2 * BUCKET_CAPACITY);
+    for (int i = 0; i < run && n < cap; i++) {
+      assert(bucket_tree_insert(t, key) == 0);
+      ref[n++] = key;
+    }
+    check_bucket_tree(t, ref, n);
+    for (int i = 0; i < run / 2; i++) {
+      const size_t j = rand() % n;
+      assert(bucket_tree_erase(t, ref[j]) == 0);
+      ref[j] = ref[--n];
+    }
+    check_bucket_tree(t, ref, n);
+  }
+  test_color_constraint(t->index);
+
+  free(ref);
+  delete_bucket_tree(t);
+}
+
+typedef struct {
+  async_rbtree *a;
+  rbtree_key_t base;
+  size_t n;
+} async_producer_arg;
+
+static void *async_producer(void *arg) {
+  const async_producer_arg *p = (const async_producer_arg *)arg;
+  for (size_t i = 0; i < p->n; i++) {
+    assert(async_rbtree_insert(p->a, p->base + (rbtree_key_t)i, NULL) == 0);
+  }
+  return NULL;
+}
+
+static void async_count(void *arg, node_t *node, int status) {
+  if (status == 0) {
+    (*(int *)arg)++;  // called only from the applier thread
+  }
+}
+
+// concurrent producers should all land in the tree after a flush
+void test_async_producers(const int producers, const size_t n) {
+  rbtree *t = new_rbtree();
+  async_rbtree *a = new_async_rbtree(t);
+  assert(a != NULL);
+
+  pthread_t threads[producers];
+  async_producer_arg args[producers];
+  for (int i = 0; i < producers; i++) {
+    args[i].a = a;
+    args[i].base = (rbtree_key_t)(i * n);
+    args[i].n = n;
+    pthread_create(&threads[i], NULL, async_producer, &args[i]);
+  }
+  for (int i = 0; i < producers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  async_rbtree_flush(a);
+
+  const size_t total = producers * n;
+  rbtree_key_t *res = calloc(total, sizeof(rbtree_key_t));
+  async_rbtree_read_lock(a);
+  assert(t->size == total);
+  rbtree_to_array(t, res, total);
+  test_color_constraint(t);
+  async_rbtree_read_unlock(a);
+  for (size_t i = 0; i < total; i++) {
+    assert(res[i] == (rbtree_key_t)i);
+  }
+
+  // futures report the node or the failure of each request
+  async_future f1, f2, f3;
+  async_future_init(&f1);
+  async_future_init(&f2);
+  async_future_init(&f3);
+  async_rbtree_erase(a, 0, &f1);
+  async_rbtree_erase(a, 0, &f2);
+  async_rbtree_insert(a, -5, &f3);
+  int status;
+  assert(async_future_wait(&f1, &status) == NULL && status == 0);
+  assert(async_future_wait(&f2, &status) == NULL && status == -1);
+  node_t *p = async_future_wait(&f3, &status);
+  assert(p != NULL && p->key == -5 && status == 0);
+  async_future_destroy(&f1);
+  async_future_destroy(&f2);
+  async_future_destroy(&f3);
+
+  int erased = 0;
+  for (size_t i = 1; i < total; i += 2) {
+    async_rbtree_submit(a, ASYNC_ERASE, (rbtree_key_t)i, async_count, &erased);
+  }
+  async_rbtree_flush(a);
+  assert((size_t)erased == total / 2);
+  assert(t->size == total - total / 2);
+
+  delete_async_rbtree(a);
+  delete_rbtree(t);
+  free(res);
+}
+
+typedef struct {
+  async_rbtree *a;
+  rbtree_key_t n;
+  unsigned int seed;
+} async_reader_arg;
+
+static void *async_reader(void *arg) {
+  async_reader_arg *r = (async_reader_arg *)arg;
+  for (int i = 0; i < 20000; i++) {
+    const rbtree_key_t k = rand_r(&r->seed) % r->n;
+    async_rbtree_read_lock(r->a);
+    node_t *p = rbtree_find(r->a->tree, k);
+    assert(k % 2 == 1 ? p != NULL && p->key == k : p == NULL || p->key == k);
+    async_rbtree_read_unlock(r->a);
+  }
+  return NULL;
+}
+
+// readers of a cached tree also write the cache, so the front-end must let
+// them in one at a time while the applier erases underneath
+void test_async_cached_readers(const rbtree_key_t n) {
+  rbtree *t = new_rbtree();
+  assert(rbtree_enable_cache(t, 16) == 0);
+  async_rbtree *a = new_async_rbtree(t);
+  for (rbtree_key_t k = 0; k < n; k++) {
+    async_rbtree_insert(a, k, NULL);
+  }
+  async_rbtree_flush(a);
+
+  pthread_t threads[4];
+  async_reader_arg args[4];
+  for (int i = 0; i < 4; i++) {
+    args[i].a = a;
+    args[i].n = n;
+    args[i].seed = 73 + i;
+    pthread_create(&threads[i], NULL, async_reader, &args[i]);
+  }
+  for (rbtree_key_t k = 0; k < n; k += 2) {
+    async_rbtree_erase(a, k, NULL);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  async_rbtree_flush(a);
+  assert(t->size == (size_t)(n / 2));
+  for (rbtree_key_t k = 0; k < n; k++) {
+    assert((rbtree_find(t, k) != NULL) == (k % 2 == 1));
+  }
+
+  delete_async_rbtree(a);
+  delete_rbtree(t);
+}
+
+// trace records should read back in order with stable tree ids
+void test_trace_roundtrip(void) {
+  const char *path = "test-rbtree.trace";
+  int t1, t2;  // stand-ins for tree pointers
+  assert(rbtree_trace_open(path) == 0);
+  rbtree_trace_record(TRACE_NEW, &t1, 0, 0);
+  rbtree_trace_record(TRACE_INSERT, &t1, 42, 0);
+  rbtree_trace_record(TRACE_FIND, &t2, -7, 0);  // implicit TRACE_NEW for t2
+  rbtree_trace_record(TRACE_INSERT_INTERVAL, &t2, 3, 9);
+  rbtree_trace_record(TRACE_DELETE, &t1, 0, 0);
+  rbtree_trace_close();
+
+  const trace_op_t ops[] = {TRACE_NEW,  TRACE_INSERT,          TRACE_NEW,
+                            TRACE_FIND, TRACE_INSERT_INTERVAL, TRACE_DELETE};
+  const uint32_t trees[] = {1, 1, 2, 2, 2, 1};
+  const int64_t keys[] = {0, 42, 0, -7, 3, 0};
+  const int64_t args[] = {0, 0, 0, 0, 9, 0};
+  FILE *fp = rbtree_trace_open_read(path);
+  assert(fp != NULL);
+  trace_rec_t rec;
+  uint64_t prev_ns = 0;
+  for (int i = 0; i < 6; i++) {
+    assert(rbtree_trace_next(fp, &rec) == 1);
+    assert(rec.op == ops[i] && rec.tree == trees[i] && rec.key == keys[i] &&
+           rec.arg == args[i]);
+    assert(rec.ns >= prev_ns);
+    prev_ns = rec.ns;
+  }
+  assert(rbtree_trace_next(fp, &rec) == 0);
+  fclose(fp);
+
+  // an unknown op or a cut-off record is an error, not the end of the trace
+  fp = fopen(path, "ab");
+  memset(&rec, 0, sizeof(rec));
+  rec.tree = 1;
+  rec.op = TRACE_OP_COUNT;
+  fwrite(&rec, sizeof(rec), 1, fp);
+  fwrite(&rec, sizeof(rec) / 2, 1, fp);
+  fclose(fp);
+  fp = rbtree_trace_open_read(path);
+  for (int i = 0; i < 6; i++) {
+    assert(rbtree_trace_next(fp, &rec) == 1);
+  }
+  assert(rbtree_trace_next(fp, &rec) == -1);
+  assert(rbtree_trace_next(fp, &rec) == -1);
+  fclose(fp);
+  remove(path);
+}
+
+#ifdef RBTREE_TRACE
+// a replayed tree should match the recorded one in mode and contents
+static void assert_same_tree(const rbtree *a, const rbtree *b) {
+  assert(a != NULL && b != NULL);
+  assert(a->size == b->size && a->dead == b->dead);
+  assert(a->capacity == b->capacity && a->keep == b->keep);
+  assert(a->max_dead == b->max_dead);
+  assert((a->cache == NULL) == (b->cache == NULL));
+  assert(a->cache == NULL || a->cache->mask == b->cache->mask);
+  assert((a->bound == NULL) == (b->bound == NULL));
+  assert(a->bound == NULL || a->bound->key == b->bound->key);
+
+  node_t *p = rbtree_min(a);
+  node_t *q = rbtree_min(b);
+  p = p == a->nil ? NULL : p;
+  q = q == b->nil ? NULL : q;
+  while (p != NULL) {
+    assert(q != NULL && p->key == q->key);
+#ifdef RBTREE_INTERVAL
+    assert(p->high == q->high);
+#endif
+    p = rbtree_next(a, p);
+    q = rbtree_next(b, q);
+  }
+  assert(q == NULL);
+}
+
+// same shape, colors and tombstones node by node
+static void assert_same_shape(const rbtree *a, const node_t *p, const rbtree *b,
+                              const node_t *q) {
+  assert((p == a->nil) == (q == b->nil));
+  if (p == a->nil) {
+    return;
+  }
+  assert(p->key == q->key && p->color == q->color && p->dead == q->dead);
+  assert_same_shape(a, p->left, b, q->left);
+  assert_same_shape(a, p->right, b, q->right);
+}
+
+// record a workload touching every tree mode, replay it and compare the trees
+void test_trace_replay(void) {
+  const char *path = "test-rbtree-replay.trace";
+  assert(rbtree_trace_open(path) == 0);
+
+  rbtree *b = new_bounded_rbtree(8, RBTREE_KEEP_LARGEST);
+  for (rbtree_key_t i = 0; i < 50; i++) {
+    rbtree_insert(b, (i * 37) % 50);
+  }
+
+  rbtree *l = new_lazy_rbtree(0.5);
+  assert(rbtree_enable_cache(l, 16) == 0);
+  node_t *held = rbtree_insert(l, 5000);
+  for (rbtree_key_t i = 0; i < 200; i++) {
+    rbtree_insert(l, i % 50);  // duplicates
+  }
+  for (rbtree_key_t i = 0; i < 40; i++) {
+    rbtree_erase_key(l, i * 3 % 50);
+  }
+  for (int i = 0; i < 20; i++) {
+    rbtree_erase(l, rbtree_min(l));
+  }
+  rbtree_insert(l, 1000);
+  rbtree_erase(l, held);  // not the last node returned: replay looks it up
+  rbtree_compact(l, 7);
+
+  rbtree *c = rbtree_clone(l);
+  rbtree_erase(c, rbtree_max(c));
+  rbtree_insert(c, -3);
+
+  rbtree_key_t arr[100];
+  for (int i = 0; i < 100; i++) {
+    arr[i] = 2 * i;
+  }
+  rbtree *s = rbtree_from_sorted_array(arr, 100, 2);
+#ifdef RBTREE_INTERVAL
+  rbtree_insert_interval(s, 7, 300);
+#endif
+  rbtree_erase_key(s, 40);
+  rbtree_key_t out[101];
+  rbtree_to_array_parallel(s, out, 101, 2);
+
+  // erase duplicates through held pointers: replay must pick the same ones
+  rbtree *d = new_rbtree();
+  node_t *dup[40];
+  for (int i = 0; i < 40; i++) {
+    dup[i] = rbtree_insert(d, i % 3 == 0 ? 9 : i);
+  }
+  const int gone_dups[] = {21, 3, 36, 12};
+  for (int i = 0; i < 4; i++) {
+    rbtree_erase(d, dup[gone_dups[i]]);
+  }
+
+  rbtree *gone = new_rbtree();
+  rbtree_insert(gone, 1);
+  delete_rbtree(gone);
+  rbtree_trace_close();
+
+  trace_replay_t r;
+  assert(rbtree_trace_replay_open(&r, path) == 0);
+  trace_rec_t rec;
+  int got;
+  while ((got = rbtree_trace_replay_next(&r, &rec)) > 0) {
+    rbtree_trace_replay_apply(&r, &rec);
+  }
+  assert(got == 0);
+
+  assert_same_tree(b, rbtree_trace_replay_tree(&r, 1));
+  assert_same_tree(l, rbtree_trace_replay_tree(&r, 2));
+  assert_same_tree(c, rbtree_trace_replay_tree(&r, 3));
+  assert_same_tree(s, rbtree_trace_replay_tree(&r, 4));
+  rbtree *rd = rbtree_trace_replay_tree(&r, 5);
+  assert_same_tree(d, rd);
+  assert_same_shape(d, d->root, rd, rd->root);
+  assert_same_shape(l, l->root, rbtree_trace_replay_tree(&r, 2),
+                    rbtree_trace_replay_tree(&r, 2)->root);
+  assert(rbtree_trace_replay_tree(&r, 6) == NULL);
+  rbtree_trace_replay_close(&r);
+  remove(path);
+
+  delete_rbtree(b);
+  delete_rbtree(l);
+  delete_rbtree(c);
+  delete_rbtree(s);
+  delete_rbtree(d);
+}
+#endif
+
+#ifdef RBTREE_WAVL
+// WAVL rank rule: rank differences are 1 or 2 and leaves have rank 0
+static int wavl_rank_traverse(const node_t *p, const node_t *nil) {
+  if (p == nil) {
+    return 0;
+  }
+  const int ld = p->rank - p->left->rank;
+  const int rd = p->rank - p->right->rank;
+  assert(ld == 1 || ld == 2);
+  assert(rd == 1 || rd == 2);
+  if (p->left == nil && p->right == nil) {
+    assert(p->rank == 0);
+  }
+  return 1 + wavl_rank_traverse(p->left, nil) +
+         wavl_rank_traverse(p->right, nil);
+}
+
+// random inserts and erases should keep the rank rule and valid colors
+void test_wavl_rand(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  node_t **nodes = calloc(n, sizeof(node_t *));
+  for (size_t round = 0; round < 4; round++) {
+    for (size_t i = 0; i < n; i++) {
+      if (nodes[i] == NULL) {
+        nodes[i] = rbtree_insert(t, rand() % 1000);
+      } else if (rand() % 2) {
+        rbtree_erase(t, nodes[i]);
+        nodes[i] = NULL;
+      }
+    }
+    assert((size_t)wavl_rank_traverse(t->root, t->nil) == t->size);
+    test_color_constraint(t);
+    test_search_constraint(t);
+  }
+  free(nodes);
+  delete_rbtree(t);
+}
+#endif
+
+// clone should copy structure and colors into one block, independent of t
+void test_clone_rand(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  rbtree_key_t *arr = calloc(n, sizeof(rbtree_key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % 1000;
+#ifdef RBTREE_INTERVAL
+    rbtree_insert_interval(t, arr[i], arr[i] + rand() % 10);
+#else
+    rbtree_insert(t, arr[i]);
+#endif
+  }
+
+  rbtree *c = rbtree_clone(t);
+  assert(c != NULL && c->size == n && c->nil != t->nil);
+  test_color_constraint(c);
+  test_search_constraint(c);
+
+  // same shape and colors, and nodes laid out in key order
+  rbtree_key_t *res = calloc(n, sizeof(rbtree_key_t));
+  rbtree_to_array(c, res, n);
+  qsort((void *)arr, n, sizeof(rbtree_key_t), comp);
+  size_t i = 0;
+  for (node_t *p = rbtree_min(c); p != NULL; p = rbtree_next(c, p), i++) {
+    assert(p == &c->block[i]);
+    assert(res[i] == arr[i]);
+  }
+  assert(i == n);
+  assert(c->root->color == t->root->color && c->root->key == t->root->key);
+#ifdef RBTREE_INTERVAL
+  assert(rbtree_overlap_all(c, 500, 505, NULL, 0) == 0);
+#endif
+
+  // mixing block nodes and heap nodes in the clone
+  for (size_t k = 0; k < n / 2; k++) {
+    rbtree_erase(c, rbtree_find(c, arr[k]));
+    rbtree_insert(c, -(rbtree_key_t)k);
+  }
+  assert(c->heap_nodes == n / 2);
+  test_color_constraint(c);
+  assert(t->size == n && c->size == n);
+  rbtree_to_array(t, res, n);
+  for (size_t k = 0; k < n; k++) {
+    assert(res[k] == arr[k]);
+  }
+
+  rbtree *empty = new_rbtree();
+  rbtree *empty_clone = rbtree_clone(empty);
+  assert(empty_clone != NULL && empty_clone->root == empty_clone->nil);
+  delete_rbtree(empty_clone);
+  delete_rbtree(empty);
+
+  free(res);
+  free(arr);
+  delete_rbtree(c);
+  delete_rbtree(t);
+}
+
+// parallel export should match the sequential one, including truncation
+void test_to_array_parallel(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, rand() % 5000);
+  }
+  rbtree_key_t *expected = calloc(n, sizeof(rbtree_key_t));
+  rbtree_key_t *res = calloc(n, sizeof(rbtree_key_t));
+  rbtree_to_array(t, expected, n);
+  const int threads[] = {1, 2, 3, 8};
+  for (int k = 0; k < 4; k++) {
+    memset(res, 0, n * sizeof(rbtree_key_t));
+    assert(rbtree_to_array_parallel(t, res, n, threads[k]) == n);
+    assert(memcmp(res, expected, n * sizeof(rbtree_key_t)) == 0);
+
+    // only the first n / 3 keys fit
+    memset(res, 0, n * sizeof(rbtree_key_t));
+    assert(rbtree_to_array_parallel(t, res, n / 3, threads[k]) == n / 3);
+    assert(memcmp(res, expected, n / 3 * sizeof(rbtree_key_t)) == 0);
+    assert(res[n / 3] == 0);
+  }
+  free(res);
+  free(expected);
+  delete_rbtree(t);
+}
+
+typedef struct {
+  const rbtree *t;
+  const rbtree_key_t *expected;
+  size_t n;
+} export_caller_t;
+
+static void *export_caller(void *arg) {
+  const export_caller_t *c = arg;
+  rbtree_key_t *res = calloc(c->n, sizeof(rbtree_key_t));
+  for (int round = 0; round < 20; round++) {
+    assert(rbtree_to_array_parallel(c->t, res, c->n, 4) == c->n);
+    assert(memcmp(res, c->expected, c->n * sizeof(rbtree_key_t)) == 0);
+  }
+  free(res);
+  return NULL;
+}
+
+// several threads exporting at once share one worker pool; a caller that
+// finds the pool busy does its export alone
+void test_to_array_parallel_callers(const size_t n) {
+  rbtree *t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, (i * 7919) % n);
+  }
+  rbtree_key_t *expected = calloc(n, sizeof(rbtree_key_t));
+  rbtree_to_array(t, expected, n);
+
+  export_caller_t c = {t, expected, n};
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    pthread_create(&threads[i], NULL, export_caller, &c);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(expected);
+  delete_rbtree(t);
+}
+
+// building from a sorted array should give a valid, balanced tree
+void test_from_sorted_array(const size_t n, const int nthreads) {
+  rbtree_key_t *arr = calloc(n + 1, sizeof(rbtree_key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = (rbtree_key_t)(i / 3);  // with duplicates
+  }
+  rbtree *t = rbtree_from_sorted_array(arr, n, nthreads);
+  assert(t != NULL && t->size == n);
+  test_color_constraint(t);
+  test_search_constraint(t);
+#ifdef RBTREE_WAVL
+  assert((size_t)wavl_rank_traverse(t->root, t->nil) == n);
+#endif
+#if defined(RBTREE_INTERVAL) && defined(SENTINEL)
+  max_high_traverse(t->root, t->nil);
+#endif
+
+  rbtree_key_t *res = calloc(n + 1, sizeof(rbtree_key_t));
+  rbtree_to_array(t, res, n);
+  assert(memcmp(res, arr, n * sizeof(rbtree_key_t)) == 0);
+
+  // the built tree stays fully mutable
+  if (n > 0) {
+    rbtree_erase(t, rbtree_find(t, arr[n / 2]));
+    rbtree_insert(t, -1);
+    test_color_constraint(t);
+    assert(rbtree_min(t)->key == -1);
+  }
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// expects the live keys of t to be exactly the sorted multiset keys[0..m)
+static void check_live_keys(const rbtree *t, const rbtree_key_t *keys, const size_t m) {
+  assert(rbtree_size(t) == m);
+  rbtree_key_t *res = calloc(m + 1, sizeof(rbtree_key_t));
+  assert(rbtree_to_array(t, res, m + 1) == m);
+  assert(memcmp(res, keys, m * sizeof(rbtree_key_t)) == 0);
+  memset(res, 0, (m + 1) * sizeof(rbtree_key_t));
+  assert(rbtree_to_array_parallel(t, res, m + 1, 4) == m);
+  assert(memcmp(res, keys, m * sizeof(rbtree_key_t)) == 0);
+
+  size_t i = 0;
+  for (node_t *p = rbtree_min(t); p != NULL && p != t->nil;
+       p = rbtree_next(t, p), i++) {
+    assert(!p->dead && p->key == keys[i]);
+  }
+  assert(i == m);
+  for (node_t *p = rbtree_max(t); p != NULL && p != t->nil;
+       p = rbtree_prev(t, p)) {
+    assert(!p->dead && p->key == keys[--i]);
+  }
+  assert(i == 0);
+  free(res);
+}
+
+// all_dead of every node should say whether its whole subtree is tombstones
+static bool all_dead_traverse(const node_t *p, const node_t *nil) {
+  if (p == nil) {
+    return true;
+  }
+  const bool l = all_dead_traverse(p->left, nil);
+  const bool r = all_dead_traverse(p->right, nil);
+  const bool all = p->dead && l && r;
+  assert(p->all_dead == all);
+  return all;
+}
+
+static void check_all_dead(const rbtree *t) {
+#ifdef SENTINEL
+  all_dead_traverse(t->root, t->nil);
+#else
+  all_dead_traverse(t->root, NULL);
+#endif
+}
+
+// lazy erase should hide tombstones from every query until compaction
+// physically removes them
+void test_lazy_erase_rand(const size_t n, const unsigned int seed) {
+  srand(seed);
+  const rbtree_key_t range = (rbtree_key_t)(n / 2);
+  rbtree *t = new_lazy_rbtree(0.5);
+  rbtree_key_t *arr = calloc(n, sizeof(rbtree_key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % range;  // with duplicates
+    rbtree_insert(t, arr[i]);
+  }
+
+  // below the threshold erases only mark nodes
+  const size_t erased = n / 3;
+  for (size_t i = 0; i < erased; i++) {
+    assert(rbtree_erase_key(t, arr[i]) == 0);
+  }
+  assert(t->size == n && t->dead == erased && t->sweep == NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+  check_all_dead(t);
+
+  rbtree_key_t *rest = arr + erased;
+  const size_t m = n - erased;
+  qsort((void *)rest, m, sizeof(rbtree_key_t), comp);
+  check_live_keys(t, rest, m);
+  for (rbtree_key_t k = 0; k < range; k++) {
+    const bool present = bsearch(&k, rest, m, sizeof(rbtree_key_t), comp) != NULL;
+    node_t *p = rbtree_find(t, k);
+    assert((p != NULL) == present);
+    assert(p == NULL || (p->key == k && !p->dead));
+#ifdef RBTREE_INTERVAL
+    assert((rbtree_overlap_first(t, k, k) != NULL) == present);
+#endif
+    if (!present) {
+      assert(rbtree_erase_key(t, k) == -1);
+    }
+  }
+
+  // bounded compaction steps, then the rest at once
+  assert(rbtree_compact(t, 10) <= 10);
+  rbtree_compact(t, 0);
+  assert(t->dead == 0 && t->size == m && t->sweep == NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+  check_live_keys(t, rest, m);
+
+  // mixed traffic: crossing the threshold compacts incrementally on the
+  // request path while inserts rebalance around the cursor
+  size_t *count = calloc(range, sizeof(size_t));
+  for (size_t i = 0; i < m; i++) {
+    count[rest[i]]++;
+  }
+  size_t physical_min = t->size;
+  for (size_t i = 0; i < 4 * n; i++) {
+    const rbtree_key_t k = rand() % range;
+    if (rand() % 3 == 0) {
+      rbtree_insert(t, k);
+      count[k]++;
+    } else {
+      assert(rbtree_erase_key(t, k) == (count[k] > 0 ? 0 : -1));
+      if (count[k] > 0) {
+        count[k]--;
+      }
+    }
+    assert(t->dead <= t->size);
+    if (i % 128 == 0) {
+      check_all_dead(t);
+    }
+    if (t->size < physical_min) {
+      physical_min = t->size;
+    }
+  }
+  assert(physical_min < m);
+  test_color_constraint(t);
+  test_search_constraint(t);
+  check_all_dead(t);
+  size_t live = 0;
+  for (rbtree_key_t k = 0; k < range; k++) {
+    for (size_t c = 0; c < count[k]; c++) {
+      arr[live++] = k;
+    }
+  }
+  check_live_keys(t, arr, live);
+
+  rbtree_compact(t, 0);
+  assert(t->dead == 0 && t->size == live);
+  check_live_keys(t, arr, live);
+
+  free(count);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// popping from either end below the threshold leaves a growing run of
+// tombstones that min/max/find must jump over rather than walk
+void test_lazy_pop_ends(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_lazy_rbtree(0.9);
+  rbtree_key_t *arr = calloc(n, sizeof(rbtree_key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (n / 4);  // with duplicates
+    rbtree_insert(t, arr[i]);
+  }
+  qsort((void *)arr, n, sizeof(rbtree_key_t), comp);
+
+  size_t lo = 0, hi = n;
+  while (hi - lo > n / 5) {
+    node_t *p = rbtree_min(t);
+    assert(p != NULL && !p->dead && p->key == arr[lo]);
+    assert(rbtree_erase(t, p) == 0);
+    lo++;
+    p = rbtree_max(t);
+    assert(p != NULL && !p->dead && p->key == arr[hi - 1]);
+    assert(rbtree_erase(t, p) == 0);
+    hi--;
+    if (lo % 64 == 0) {
+      // a key whose older copies are all tombstones is still found
+      node_t *q = rbtree_find(t, arr[lo]);
+      assert(q != NULL && !q->dead && q->key == arr[lo]);
+      assert(lo == 0 || arr[lo - 1] == arr[lo] ||
+             rbtree_find(t, arr[lo - 1]) == NULL);
+    }
+  }
+  assert(t->dead == n - (hi - lo) && t->sweep == NULL);
+  check_all_dead(t);
+  check_live_keys(t, arr + lo, hi - lo);
+
+  rbtree_compact(t, 0);
+  assert(t->dead == 0 && t->size == hi - lo);
+  check_all_dead(t);
+  test_color_constraint(t);
+  check_live_keys(t, arr + lo, hi - lo);
+
+  free(arr);
+  delete_rbtree(t);
+}
+
+// the lookup cache should only ever return live nodes holding the key
+void test_lookup_cache(const size_t n, const unsigned int seed) {
+  srand(seed);
+  const rbtree_key_t range = (rbtree_key_t)n;
+  rbtree *t = new_rbtree();
+  assert(rbtree_enable_cache(t, 50) == 0 && t->cache->mask == 63);
+  size_t *count = calloc(range, sizeof(size_t));
+  for (size_t i = 0; i < n; i++) {
+    const rbtree_key_t k = rand() % range;
+    rbtree_insert(t, k);
+    count[k]++;
+  }
+
+  // skewed lookups mixed with erases and inserts; a stale entry would hand
+  // out a freed node
+  for (size_t i = 0; i < 20 * n; i++) {
+    const rbtree_key_t k = rand() % 4 ? rand() % 32 : rand() % range;
+    const int op = rand() % 10;
+    if (op == 0) {
+      rbtree_insert(t, k);
+      count[k]++;
+    } else if (op == 1) {
+      assert(rbtree_erase_key(t, k) == (count[k] > 0 ? 0 : -1));
+      if (count[k] > 0) {
+        count[k]--;
+      }
+    } else {
+      node_t *p = rbtree_find(t, k);
+      assert((p != NULL) == (count[k] > 0));
+      assert(p == NULL || p->key == k);
+    }
+  }
+  assert(t->cache->hits > t->cache->misses);
+  test_color_constraint(t);
+
+  // erasing a node with two children relinks its successor, which keeps its
+  // identity and therefore its cache entry
+  node_t *root = t->root;
+  node_t *succ = rbtree_next(t, root);
+  assert(root->left != t->nil && root->right != t->nil && succ != NULL);
+  const rbtree_key_t succ_key = succ->key;
+  rbtree_find(t, succ_key);
+  if (root->key != succ_key) {
+    assert(rbtree_erase(t, root) == 0);
+    node_t *p = rbtree_find(t, succ_key);
+    assert(p != NULL && p->key == succ_key);
+  }
+
+  // turning the cache off and on again starts empty
+  assert(rbtree_enable_cache(t, 8) == 0);
+  assert(t->cache->hits == 0 && t->cache->misses == 0);
+  free(count);
+  delete_rbtree(t);
+
+  // tombstones and recycled bound nodes must leave the cache as well
+  rbtree *lazy = new_lazy_rbtree(0.9);
+  rbtree_enable_cache(lazy, 4);
+  rbtree_insert(lazy, 7);
+  assert(rbtree_find(lazy, 7) != NULL);
+  assert(rbtree_erase_key(lazy, 7) == 0);
+  assert(rbtree_find(lazy, 7) == NULL);
+  delete_rbtree(lazy);
+
+  rbtree *bounded = new_bounded_rbtree(2, RBTREE_KEEP_LARGEST);
+  rbtree_enable_cache(bounded, 4);
+  rbtree_insert(bounded, 1);
+  rbtree_insert(bounded, 2);
+  assert(rbtree_find(bounded, 1) != NULL);
+  rbtree_insert(bounded, 3);  // recycles the node of 1
+  assert(rbtree_find(bounded, 1) == NULL);
+  assert(rbtree_find(bounded, 3)->key == 3);
+  delete_rbtree(bounded);
+}
+
+#ifdef RBTREE_KEY64
+// the 64-bit key type must not shadow POSIX key_t
+_Static_assert(sizeof(rbtree_key_t) == 8, "64-bit keys");
+_Static_assert(sizeof(key_t) == sizeof(ftok(".", 1)), "POSIX key_t");
+
+// keys outside the 32-bit range should keep their order and identity
+void test_key64(const size_t n) {
+  rbtree *t = new_rbtree();
+  rbtree_key_t *arr = calloc(n, sizeof(rbtree_key_t));
+  for (size_t i = 0; i < n; i++) {
+    // alternate far below and far above the 32-bit range
+    arr[i] = (i % 2 ? 1 : -1) * (((rbtree_key_t)1 << 40) + (rbtree_key_t)i * 4294967311LL);
+    rbtree_insert(t, arr[i]);
+  }
+  assert(rbtree_insert(t, RBTREE_KEY_MAX) != NULL);
+  assert(rbtree_min(t)->key == -(((rbtree_key_t)1 << 40) + (rbtree_key_t)(n - 2 + n % 2) * 4294967311LL));
+  assert(rbtree_max(t)->key == RBTREE_KEY_MAX);
+  for (size_t i = 0; i < n; i++) {
+    node_t *p = rbtree_find(t, arr[i]);
+    assert(p != NULL && p->key == arr[i]);
+    // a tree that truncated keys to 32 bits would find the low half
+    assert(rbtree_find(t, (rbtree_key_t)(int)arr[i]) == NULL);
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  rbtree_key_t *res = calloc(n + 1, sizeof(rbtree_key_t));
+  assert(rbtree_to_array(t, res, n + 1) == n + 1);
+  qsort((void *)arr, n, sizeof(rbtree_key_t), comp);
+  assert(memcmp(res, arr, n * sizeof(rbtree_key_t)) == 0 && res[n] == RBTREE_KEY_MAX);
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+#endif
+
 int main(void) {
   test_init();
   test_insert_single(1024);
@@ -379,5 +1460,37 @@ int main(void) {
   test_duplicate_values();
   test_multi_instance();
   test_find_erase_rand(10000, 17);
+#ifdef RBTREE_INTERVAL
+  test_interval_rand(2000, 23);
+#endif
+  test_bounded_rand(10000, 100, RBTREE_KEEP_LARGEST, 29);
+  test_bounded_rand(10000, 100, RBTREE_KEEP_SMALLEST, 31);
+  test_bounded_rand(100, 1, RBTREE_KEEP_LARGEST, 37);
+  test_bounded_duplicates(200, 67);
+  test_bucket_tree_rand(10000, 41);
+  test_bucket_tree_dup_runs(60, 43);
+  test_async_producers(4, 2000);
+  test_async_cached_readers(64);
+  test_trace_roundtrip();
+#ifdef RBTREE_TRACE
+  test_trace_replay();
+#endif
+  test_clone_rand(2000, 47);
+  test_to_array_parallel(10000, 53);
+  test_to_array_parallel_callers(5000);
+  for (size_t n = 0; n < 70; n++) {
+    test_from_sorted_array(n, 1);
+    test_from_sorted_array(n, 4);
+  }
+  test_from_sorted_array(100000, 8);
+  test_lazy_erase_rand(5000, 59);
+  test_lazy_pop_ends(4000, 71);
+  test_lookup_cache(3000, 61);
+#ifdef RBTREE_KEY64
+  test_key64(5000);
+#endif
+#ifdef RBTREE_WAVL
+  test_wavl_rand(5000, 43);
+#endif
   printf("Passed all tests!\n");
 }